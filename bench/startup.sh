@@ -0,0 +1,42 @@
+#!/bin/sh
+#
+# Compares the end-to-end latency of cold ttyml invocations with invocations
+# forwarded to a warm daemon.
+#
+# Usage: bench/startup.sh URL [COUNT]
+
+set -e
+
+if [ $# -lt 1 ]; then
+  echo "Usage: $0 URL [COUNT]" >&2
+  exit 1
+fi
+
+URL=$1
+COUNT=${2:-100}
+TTYML=${TTYML:-./ttyml}
+SOCKET=$(mktemp -u /tmp/ttyml-bench.XXXXXX)
+
+# Prints the average wall time in milliseconds of COUNT runs of a command.
+average_ms() {
+  start=$(date +%s%N)
+  i=0
+  while [ $i -lt "$COUNT" ]; do
+    "$@" >/dev/null </dev/null
+    i=$((i + 1))
+  done
+  end=$(date +%s%N)
+  awk "BEGIN { printf \"%.3f\", ($end - $start) / $COUNT / 1000000 }"
+}
+
+echo "cold: $(average_ms "$TTYML" "$URL") ms"
+
+"$TTYML" --daemon --socket="$SOCKET" &
+DAEMON=$!
+trap 'kill $DAEMON; rm -f "$SOCKET"' EXIT
+while [ ! -S "$SOCKET" ]; do sleep 0.01; done
+
+# The first request through the daemon pays for connection setup.
+"$TTYML" --client --socket="$SOCKET" "$URL" >/dev/null </dev/null
+
+echo "warm: $(average_ms "$TTYML" --client --socket="$SOCKET" "$URL") ms"
@@ -0,0 +1,67 @@
+#!/bin/sh
+#
+# Measures how many table rows per second ttyml renders, and its peak memory
+# use, on a generated table served from a local HTTP server.
+#
+# Usage: bench/table.sh [ROWS] [WIDTHS]
+#
+# WIDTHS is passed as the widths attribute of the table; by default all
+# columns are measured from the first 100 rows.
+
+set -e
+
+ROWS=${1:-1000000}
+WIDTHS=${2:-}
+TTYML=${TTYML:-./ttyml}
+PORT=${PORT:-8766}
+WORK=$(mktemp -d /tmp/ttyml-bench.XXXXXX)
+
+python3 - "$WORK/table.ttyml" "$ROWS" "$WIDTHS" <<'PYTHON'
+import sys
+
+path, rows, widths = sys.argv[1], int(sys.argv[2]), sys.argv[3]
+
+with open(path, "w") as f:
+    f.write('<ttyml xmlns="https://ttyml.org/2018/05/26"><table')
+    if widths:
+        f.write(' widths="%s"' % widths)
+    f.write('>')
+    for i in range(rows):
+        f.write('<row><cell>%d</cell><cell>host-%d.example.org</cell>'
+                '<cell><style fg="%d">%s</style></cell><cell>%.2f</cell></row>'
+                % (i, i % 977, 1 + i % 6, "up" if i % 13 else "down",
+                   i * 0.37 % 100))
+    f.write('</table></ttyml>')
+PYTHON
+
+python3 - "$WORK" "$PORT" <<'PYTHON' &
+import functools, http.server, sys
+
+class Handler(http.server.SimpleHTTPRequestHandler):
+    extensions_map = {".ttyml": "text/ttyml"}
+
+    def log_message(self, *args):
+        pass
+
+http.server.HTTPServer(
+    ("127.0.0.1", int(sys.argv[2])),
+    functools.partial(Handler, directory=sys.argv[1])).serve_forever()
+PYTHON
+SERVER=$!
+trap 'kill $SERVER; rm -rf "$WORK"' EXIT
+sleep 0.5
+
+python3 - "$TTYML" "http://127.0.0.1:$PORT/table.ttyml" "$ROWS" <<'PYTHON'
+import resource, subprocess, sys, time
+
+ttyml, url, rows = sys.argv[1], sys.argv[2], int(sys.argv[3])
+
+start = time.monotonic()
+subprocess.run([ttyml, url], stdout=subprocess.DEVNULL,
+               stdin=subprocess.DEVNULL, check=True)
+elapsed = time.monotonic() - start
+
+print("%d rows in %.2f s: %.0f rows/s, peak RSS %d KiB"
+      % (rows, elapsed, rows / elapsed,
+         resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss))
+PYTHON
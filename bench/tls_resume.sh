@@ -0,0 +1,62 @@
+#!/bin/sh
+#
+# Counts full and resumed TLS handshakes for back-to-back ttyml invocations
+# against a local TLS server, with and without --host-cache.
+#
+# Usage: bench/tls_resume.sh [COUNT]
+
+set -e
+
+COUNT=${1:-20}
+TTYML=${TTYML:-./ttyml}
+PORT=${PORT:-8443}
+WORK=$(mktemp -d /tmp/ttyml-bench.XXXXXX)
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj /CN=localhost \
+  -addext subjectAltName=DNS:localhost \
+  -keyout "$WORK/key.pem" -out "$WORK/cert.pem" 2>/dev/null
+
+python3 - "$WORK" "$PORT" <<'PYTHON' &
+import http.server, ssl, sys
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    def log_message(self, *args):
+        pass
+
+    def do_GET(self):
+        resumed = self.connection.session_reused
+        with open(sys.argv[1] + "/handshakes", "a") as log:
+            log.write("resumed\n" if resumed else "full\n")
+        body = b'<ttyml xmlns="https://ttyml.org/2018/05/26"><line>ok</line></ttyml>'
+        self.send_response(200)
+        self.send_header("Content-Type", "text/ttyml")
+        self.send_header("Content-Length", str(len(body)))
+        self.send_header("Connection", "close")
+        self.end_headers()
+        self.wfile.write(body)
+
+context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+context.load_cert_chain(sys.argv[1] + "/cert.pem", sys.argv[1] + "/key.pem")
+server = http.server.HTTPServer(("127.0.0.1", int(sys.argv[2])), Handler)
+server.socket = context.wrap_socket(server.socket, server_side=True)
+server.serve_forever()
+PYTHON
+SERVER=$!
+trap 'kill $SERVER; rm -rf "$WORK"' EXIT
+sleep 1
+
+# Prints the number of full and resumed handshakes for COUNT invocations.
+handshakes() {
+  rm -f "$WORK/handshakes"
+  i=0
+  while [ $i -lt "$COUNT" ]; do
+    XDG_CACHE_HOME="$WORK/cache" "$TTYML" --cacert="$WORK/cert.pem" "$@" \
+      "https://localhost:$PORT/" >/dev/null </dev/null
+    i=$((i + 1))
+  done
+  echo "$(grep -c full "$WORK/handshakes") full," \
+    "$(grep -c resumed "$WORK/handshakes") resumed"
+}
+
+echo "without --host-cache: $(handshakes)"
+echo "with --host-cache:    $(handshakes --host-cache)"
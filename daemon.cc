@@ -0,0 +1,466 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "daemon.h"
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <readline/readline.h>
+
+#include "util/string.h"
+
+namespace ttyml {
+
+namespace {
+
+// Sent by the daemon as soon as it accepts a connection, before the client
+// sends its request.
+enum Reply : std::uint8_t {
+  kAccepted,
+
+  // Another session is running, so the client should run its own.
+  kBusy,
+};
+
+// Sent by the client together with its standard streams, followed by the
+// URL, the output format, the CA file and the working directory.
+struct Request {
+  std::uint32_t url_length;
+  std::uint32_t output_format_length;
+  std::uint32_t ca_file_length;
+  std::uint32_t working_directory_length;
+  std::uint8_t pager;
+  std::uint8_t fast_xml;
+};
+
+// The longest string accepted in a request.
+const std::uint32_t kMaxRequestString = 1 << 20;
+
+// The connection of the client currently being served.
+int client_fd = -1;
+
+[[noreturn]] void throw_errno(const char* what) {
+  throw std::system_error{errno, std::system_category(), what};
+}
+
+void read_all(int fd, void* buf, size_t size) {
+  auto p = static_cast<char*>(buf);
+  while (size > 0) {
+    const auto ret = read(fd, p, size);
+    if (ret == -1) {
+      if (errno == EINTR) continue;
+      throw_errno("read failed");
+    }
+    if (ret == 0) throw std::runtime_error{"unexpected end of stream"};
+    p += ret;
+    size -= ret;
+  }
+}
+
+void write_all(int fd, const void* buf, size_t size) {
+  auto p = static_cast<const char*>(buf);
+  while (size > 0) {
+    const auto ret = write(fd, p, size);
+    if (ret == -1) {
+      if (errno == EINTR) continue;
+      throw_errno("write failed");
+    }
+    p += ret;
+    size -= ret;
+  }
+}
+
+sockaddr_un make_address(const std::string& path) {
+  sockaddr_un result;
+  std::memset(&result, 0, sizeof(result));
+  result.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(result.sun_path))
+    throw std::runtime_error{string::cat("socket path too long: ", path)};
+  std::memcpy(result.sun_path, path.data(), path.size());
+  return result;
+}
+
+// Reads a key for readline from the client's terminal, reporting end of file
+// if the client disconnects, so that an abandoned session does not keep
+// reading from a terminal that now belongs to someone else.
+int client_getc(FILE* stream) {
+  pollfd fds[2];
+  fds[0].fd = fileno(stream);
+  fds[0].events = POLLIN;
+  fds[1].fd = client_fd;
+  fds[1].events = POLLIN;
+
+  for (;;) {
+    if (-1 == poll(fds, 2, -1)) {
+      if (errno == EINTR) continue;
+      return EOF;
+    }
+
+    if (fds[1].revents) return EOF;
+
+    if (fds[0].revents) {
+      unsigned char ch;
+      const auto ret = read(fds[0].fd, &ch, 1);
+      if (ret == 1) return ch;
+      if (ret == -1 && errno == EINTR) continue;
+      return EOF;
+    }
+  }
+}
+
+// Makes the client's streams the standard streams of the daemon for as long
+// as it exists, and restores the daemon's own when destroyed, even if the
+// session failed.  Takes ownership of the client's streams.
+class StreamRedirect {
+ public:
+  explicit StreamRedirect(int (&client_streams)[3]) {
+    try {
+      flush();
+
+      for (int i = 0; i < 3; ++i) {
+        saved_streams_[i] = fcntl(i, F_DUPFD_CLOEXEC, 3);
+        if (saved_streams_[i] == -1)
+          throw_errno("fcntl(F_DUPFD_CLOEXEC) failed");
+      }
+
+      for (int i = 0; i < 3; ++i) {
+        if (-1 == dup2(client_streams[i], i)) throw_errno("dup2 failed");
+      }
+    } catch (...) {
+      close_client_streams(client_streams);
+      restore();
+      throw;
+    }
+
+    close_client_streams(client_streams);
+
+    std::cout.clear();
+    std::cerr.clear();
+    clearerr(stdin);
+  }
+
+  ~StreamRedirect() {
+    // The session is over, whether or not it failed.
+    client_fd = -1;
+
+    flush();
+    restore();
+  }
+
+  StreamRedirect(const StreamRedirect&) = delete;
+  StreamRedirect& operator=(const StreamRedirect&) = delete;
+
+ private:
+  static void flush() {
+    std::cout.flush();
+    std::fflush(stdout);
+    std::fflush(stderr);
+  }
+
+  static void close_client_streams(int (&client_streams)[3]) {
+    for (auto& stream : client_streams) {
+      close(stream);
+      stream = -1;
+    }
+  }
+
+  void restore() {
+    for (int i = 0; i < 3; ++i) {
+      if (saved_streams_[i] == -1) continue;
+      while (-1 == dup2(saved_streams_[i], i) && errno == EINTR) {
+      }
+      close(saved_streams_[i]);
+      saved_streams_[i] = -1;
+    }
+
+    std::cout.clear();
+    std::cerr.clear();
+    clearerr(stdin);
+  }
+
+  int saved_streams_[3] = {-1, -1, -1};
+};
+
+// Reads a string of `length` bytes sent after a request.
+std::string read_string(int fd, std::uint32_t length) {
+  if (length > kMaxRequestString) throw std::runtime_error{"malformed request"};
+  std::string result(length, '\0');
+  if (length) read_all(fd, &result[0], length);
+  return result;
+}
+
+void serve_client(
+    int fd,
+    const std::function<int(const char* url, const ClientOptions& options)>&
+        run) {
+#ifdef SO_PEERCRED
+  ucred credentials;
+  socklen_t credentials_size = sizeof(credentials);
+  if (-1 == getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials,
+                       &credentials_size))
+    throw_errno("getsockopt(SO_PEERCRED) failed");
+  if (credentials.uid != getuid())
+    throw std::runtime_error{"rejected client owned by another user"};
+#endif
+
+  const std::uint8_t reply = kAccepted;
+  write_all(fd, &reply, sizeof(reply));
+
+  Request request;
+  int client_streams[3];
+
+  iovec iov;
+  iov.iov_base = &request;
+  iov.iov_len = sizeof(request);
+
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(client_streams))];
+
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t ret;
+  while (-1 == (ret = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC)) && errno == EINTR) {
+  }
+  if (ret == -1) throw_errno("recvmsg failed");
+
+  const auto cmsg = CMSG_FIRSTHDR(&msg);
+  if (ret != sizeof(request) || !cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(client_streams)))
+    throw std::runtime_error{"malformed request"};
+  std::memcpy(client_streams, CMSG_DATA(cmsg), sizeof(client_streams));
+
+  std::string url;
+  ClientOptions options;
+  try {
+    url = read_string(fd, request.url_length);
+    options.output_format_ = read_string(fd, request.output_format_length);
+    options.ca_file_ = read_string(fd, request.ca_file_length);
+    options.working_directory_ =
+        read_string(fd, request.working_directory_length);
+    options.pager_ = request.pager;
+    options.fast_xml_ = request.fast_xml;
+
+    const auto& format = options.output_format_;
+    if (format != "auto" && format != "terminal" && format != "plain" &&
+        format != "jsonl")
+      throw std::runtime_error{"malformed request"};
+    if (options.working_directory_.empty() ||
+        options.working_directory_[0] != '/')
+      throw std::runtime_error{"malformed request"};
+  } catch (...) {
+    for (const auto stream : client_streams) close(stream);
+    throw;
+  }
+
+  std::int32_t exit_status;
+  {
+    StreamRedirect redirect{client_streams};
+
+    // Pick up the size of the client's terminal, once readline is
+    // initialized.
+    if (rl_instream) rl_reset_screen_size();
+
+    client_fd = fd;
+    exit_status = run(url.c_str(), options);
+  }
+
+  write_all(fd, &exit_status, sizeof(exit_status));
+}
+
+}  // namespace
+
+std::string default_socket_path() {
+  if (const auto runtime_dir = std::getenv("XDG_RUNTIME_DIR"))
+    return string::cat(runtime_dir, "/ttyml.sock");
+  return string::cat("/tmp/ttyml-", getuid(), ".sock");
+}
+
+void serve(const std::string& socket_path,
+           const std::function<int(const char* url,
+                                   const ClientOptions& options)>& run) {
+  const auto address = make_address(socket_path);
+
+  const auto listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd == -1) throw_errno("socket failed");
+
+  unlink(socket_path.c_str());
+  if (-1 == bind(listen_fd, reinterpret_cast<const sockaddr*>(&address),
+                 sizeof(address)))
+    throw_errno("bind failed");
+  if (-1 == listen(listen_fd, 64)) throw_errno("listen failed");
+
+  // Writes to a client that went away must not terminate the daemon.
+  signal(SIGPIPE, SIG_IGN);
+
+  rl_getc_function = client_getc;
+
+  // Connections are accepted on a thread of their own, so that clients
+  // arriving while a session runs are turned away at once, rather than left
+  // waiting for a session that may sit at a prompt indefinitely.
+  std::mutex mutex;
+  std::condition_variable ready;
+  int next_fd = -1;
+  bool busy = false;
+  std::exception_ptr accept_error;
+
+  std::thread acceptor{[&] {
+    for (;;) {
+      const auto fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd == -1) {
+        if (errno == EINTR || errno == ECONNABORTED) continue;
+
+        const auto error = std::make_exception_ptr(std::system_error{
+            errno, std::system_category(), "accept failed"});
+        std::lock_guard<std::mutex> lock{mutex};
+        accept_error = error;
+        ready.notify_one();
+        return;
+      }
+
+      {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (!busy) {
+          busy = true;
+          next_fd = fd;
+          ready.notify_one();
+          continue;
+        }
+      }
+
+      const std::uint8_t reply = kBusy;
+      send(fd, &reply, sizeof(reply), MSG_NOSIGNAL | MSG_DONTWAIT);
+      close(fd);
+    }
+  }};
+
+  for (;;) {
+    int fd;
+    {
+      std::unique_lock<std::mutex> lock{mutex};
+      ready.wait(lock, [&] { return next_fd != -1 || accept_error; });
+      if (accept_error) {
+        lock.unlock();
+        acceptor.join();
+        std::rethrow_exception(accept_error);
+      }
+      fd = next_fd;
+      next_fd = -1;
+    }
+
+    try {
+      serve_client(fd, run);
+    } catch (std::exception& e) {
+      std::cerr << "Error serving client: " << e.what() << '\n';
+    }
+
+    close(fd);
+
+    std::lock_guard<std::mutex> lock{mutex};
+    busy = false;
+  }
+}
+
+bool forward(const std::string& socket_path, const char* url,
+             const ClientOptions& options, int* exit_status) {
+  const auto address = make_address(socket_path);
+
+  const auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) throw_errno("socket failed");
+
+  if (-1 == connect(fd, reinterpret_cast<const sockaddr*>(&address),
+                    sizeof(address))) {
+    close(fd);
+    return false;
+  }
+
+  try {
+    // A daemon that is busy, or that went away, leaves the session to us.
+    std::uint8_t reply;
+    ssize_t ret;
+    while (-1 == (ret = read(fd, &reply, sizeof(reply))) && errno == EINTR) {
+    }
+    if (ret != sizeof(reply) || reply != kAccepted) {
+      close(fd);
+      return false;
+    }
+
+    const int streams[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+
+    Request request;
+    std::memset(&request, 0, sizeof(request));
+    request.url_length = std::strlen(url);
+    request.output_format_length = options.output_format_.size();
+    request.ca_file_length = options.ca_file_.size();
+    request.working_directory_length = options.working_directory_.size();
+    request.pager = options.pager_;
+    request.fast_xml = options.fast_xml_;
+
+    iovec iov;
+    iov.iov_base = &request;
+    iov.iov_len = sizeof(request);
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(streams))];
+    std::memset(control, 0, sizeof(control));
+
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    const auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(streams));
+    std::memcpy(CMSG_DATA(cmsg), streams, sizeof(streams));
+
+    while (-1 == (ret = sendmsg(fd, &msg, 0)) && errno == EINTR) {
+    }
+    if (ret != sizeof(request)) throw_errno("sendmsg failed");
+
+    write_all(fd, url, request.url_length);
+    write_all(fd, options.output_format_.data(),
+              options.output_format_.size());
+    write_all(fd, options.ca_file_.data(), options.ca_file_.size());
+    write_all(fd, options.working_directory_.data(),
+              options.working_directory_.size());
+
+    std::int32_t status;
+    read_all(fd, &status, sizeof(status));
+    *exit_status = status;
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+
+  close(fd);
+
+  return true;
+}
+
+}  // namespace ttyml
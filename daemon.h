@@ -0,0 +1,46 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+namespace ttyml {
+
+// The options of an invocation that apply to the session it runs.  A client
+// sends them along with its URL, so that the session the daemon runs for it
+// behaves as if it had been run by the client itself.
+struct ClientOptions {
+  // One of "auto", "terminal", "plain" and "jsonl", as for --output.
+  std::string output_format_ = "auto";
+
+  bool pager_ = false;
+
+  // Relative to `working_directory_`, if not absolute.
+  std::string ca_file_;
+
+  bool fast_xml_ = true;
+
+  // The client's working directory, an absolute path, against which the
+  // daemon resolves the relative paths the client gives.
+  std::string working_directory_;
+};
+
+// Returns the path of the daemon's socket, unless overridden on the command
+// line.
+std::string default_socket_path();
+
+// Accepts sessions forwarded by `forward` on `socket_path`, and runs them one
+// at a time with `run`, using the client's standard streams and options.
+// Clients that arrive while a session runs are told to run their own.  Never
+// returns.
+void serve(const std::string& socket_path,
+           const std::function<int(const char* url,
+                                   const ClientOptions& options)>& run);
+
+// Asks the daemon listening on `socket_path` to run a session for `url` with
+// `options` on this process' standard streams, and stores its exit status in
+// `exit_status`.  Returns false if no daemon is listening, or if it is busy
+// with another session.
+bool forward(const std::string& socket_path, const char* url,
+             const ClientOptions& options, int* exit_status);
+
+}  // namespace ttyml
@@ -0,0 +1,277 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "host_cache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include <sys/stat.h>
+
+#ifdef HAVE_OPENSSL
+#include <openssl/ssl.h>
+#endif
+
+#include "util/string.h"
+#include "util/url.h"
+
+namespace ttyml {
+
+namespace {
+
+// Returns "host:port" for the host `url` refers to, or an empty string if it
+// has none.  The host name alone is stored in `host`.
+std::string host_key(const std::string& url, std::string* host) {
+  const auto parts = url::parse(url);
+  if (!string::starts_with(parts.host, "//")) return std::string{};
+
+  auto authority = parts.host.substr(2);
+  const auto at = authority.rfind('@');
+  if (at != std::string::npos) authority.erase(0, at + 1);
+
+  std::string port;
+  const auto port_separator = authority.rfind(':');
+  if (port_separator != std::string::npos &&
+      authority.find(']', port_separator) == std::string::npos) {
+    port = authority.substr(port_separator + 1);
+    authority.erase(port_separator);
+  }
+
+  if (port.empty()) {
+    if (parts.scheme == "http:")
+      port = "80";
+    else if (parts.scheme == "https:")
+      port = "443";
+    else
+      return std::string{};
+  }
+
+  if (authority.empty()) return std::string{};
+
+  *host = authority;
+
+  return string::cat(authority, ':', port);
+}
+
+// Returns true if `host` is an IP address rather than a name.
+bool is_address(const std::string& host) {
+  if (host[0] == '[') return true;
+  return host.find_first_not_of("0123456789.") == std::string::npos;
+}
+
+// Creates `path` and its missing parents, accessible only by the current
+// user.
+void make_directories(const std::string& path) {
+  for (auto i = path.find('/', 1);; i = path.find('/', i + 1)) {
+    mkdir(path.substr(0, i).c_str(), 0700);
+    if (i == std::string::npos) break;
+  }
+}
+
+}  // namespace
+
+#ifdef HAVE_OPENSSL
+
+struct HostCache::Ssl {
+  static int ex_data_index;
+
+  // The callbacks curl installed before ours.
+  static int (*curl_new_session)(SSL* ssl, SSL_SESSION* session);
+  static void (*curl_info_callback)(const SSL* ssl, int where, int ret);
+
+  static bool available() {
+    const auto version = curl_version_info(CURLVERSION_NOW);
+    return version->ssl_version &&
+           string::starts_with(version->ssl_version, "OpenSSL");
+  }
+
+  static HostCache* cache(const SSL* ssl) {
+    return static_cast<HostCache*>(
+        SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ex_data_index));
+  }
+
+  static CURLcode ctx_callback(CURL* curl, void* void_ctx, void* data) {
+    static std::once_flag once;
+    std::call_once(once, [] {
+      ex_data_index =
+          SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    });
+
+    const auto ctx = static_cast<SSL_CTX*>(void_ctx);
+
+    if (!SSL_CTX_set_ex_data(ctx, ex_data_index, data))
+      return CURLE_SSL_CONNECT_ERROR;
+
+    const auto new_session_callback = SSL_CTX_sess_get_new_cb(ctx);
+    if (new_session_callback != new_session)
+      curl_new_session = new_session_callback;
+    const auto existing_info_callback = SSL_CTX_get_info_callback(ctx);
+    if (existing_info_callback != info_callback)
+      curl_info_callback = existing_info_callback;
+
+    SSL_CTX_set_session_cache_mode(ctx, SSL_CTX_get_session_cache_mode(ctx) |
+                                            SSL_SESS_CACHE_CLIENT |
+                                            SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, new_session);
+    SSL_CTX_set_info_callback(ctx, info_callback);
+
+    return CURLE_OK;
+  }
+
+  // Called by OpenSSL when the server hands us a session, possibly after the
+  // handshake in the case of TLS 1.3 tickets.
+  static int new_session(SSL* ssl, SSL_SESSION* session) {
+    const auto host = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+    const auto size = i2d_SSL_SESSION(session, nullptr);
+
+    if (host && size > 0 && SSL_SESSION_is_resumable(session)) {
+      disk_cache::entry e;
+      e.value.resize(size);
+      auto p = reinterpret_cast<unsigned char*>(&e.value[0]);
+      i2d_SSL_SESSION(session, &p);
+
+      e.expires = SSL_SESSION_get_time(session) +
+                  SSL_SESSION_get_timeout(session);
+      const auto lifetime_hint = SSL_SESSION_get_ticket_lifetime_hint(session);
+      if (lifetime_hint > 0)
+        e.expires = std::min<std::time_t>(
+            e.expires, SSL_SESSION_get_time(session) + lifetime_hint);
+
+      const auto host_cache = cache(ssl);
+      host_cache->sessions_[host] = e;
+      host_cache->session_updates_[host] = std::move(e);
+    }
+
+    return curl_new_session ? curl_new_session(ssl, session) : 0;
+  }
+
+  // Offers a remembered session when a handshake starts without one.
+  static void info_callback(const SSL* const_ssl, int where, int ret) {
+    if (curl_info_callback) curl_info_callback(const_ssl, where, ret);
+
+    if (!(where & SSL_CB_HANDSHAKE_START)) return;
+
+    const auto ssl = const_cast<SSL*>(const_ssl);
+    if (SSL_get_session(ssl)) return;
+
+    const auto host = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+    if (!host) return;
+
+    const auto host_cache = cache(ssl);
+    const auto i = host_cache->sessions_.find(host);
+    if (i == host_cache->sessions_.end()) return;
+
+    auto p = reinterpret_cast<const unsigned char*>(i->second.value.data());
+    const auto session =
+        d2i_SSL_SESSION(nullptr, &p, i->second.value.size());
+    if (!session) return;
+
+    SSL_set_session(ssl, session);
+    SSL_SESSION_free(session);
+  }
+};
+
+int HostCache::Ssl::ex_data_index = -1;
+int (*HostCache::Ssl::curl_new_session)(SSL* ssl, SSL_SESSION* session);
+void (*HostCache::Ssl::curl_info_callback)(const SSL* ssl, int where, int ret);
+
+#endif  // HAVE_OPENSSL
+
+HostCache::HostCache(std::string directory)
+    : addresses_path_{directory + "/addresses"},
+      sessions_path_{directory + "/tls-sessions"},
+      now_{std::time(nullptr)} {
+  make_directories(directory);
+
+  // The cache is an optimization, so failing to use it is not an error.
+  try {
+    addresses_ = disk_cache::load(addresses_path_, now_);
+    sessions_ = disk_cache::load(sessions_path_, now_);
+  } catch (std::system_error&) {
+  }
+}
+
+std::string HostCache::default_directory() {
+  if (const auto cache_home = std::getenv("XDG_CACHE_HOME"))
+    return string::cat(cache_home, "/ttyml");
+  if (const auto home = std::getenv("HOME"))
+    return string::cat(home, "/.cache/ttyml");
+  return ".ttyml-cache";
+}
+
+bool HostCache::prepare(CURL* curl, const std::string& url,
+                        curl::string_list* resolve) {
+  std::string host;
+  const auto key = host_key(url, &host);
+  if (key.empty()) return false;
+
+#ifdef HAVE_OPENSSL
+  if (Ssl::available() && url::parse(url).scheme == "https:") {
+    curl::setopt(curl, CURLOPT_SSL_CTX_FUNCTION, Ssl::ctx_callback);
+    curl::setopt(curl, CURLOPT_SSL_CTX_DATA, this);
+  }
+#endif
+
+  const auto address = addresses_.find(key);
+  if (address == addresses_.end()) return false;
+
+  resolve->append(string::cat(key, ':', address->second.value));
+  curl::setopt(curl, CURLOPT_RESOLVE, resolve->get());
+
+  return true;
+}
+
+void HostCache::update(CURL* curl, const std::string& url) {
+  char* ip = nullptr;
+  if (CURLE_OK != curl_easy_getinfo(curl, CURLINFO_PRIMARY_IP, &ip) || !ip ||
+      !*ip)
+    return;
+
+  std::string host;
+  const auto key = host_key(url, &host);
+  if (key.empty() || is_address(host)) return;
+
+  const auto address =
+      std::strchr(ip, ':') ? string::cat('[', ip, ']') : std::string{ip};
+
+  const auto i = addresses_.find(key);
+  if (i != addresses_.end() && i->second.value == address) return;
+
+  disk_cache::entry e;
+  e.expires = now_ + kAddressTtl;
+  e.value = address;
+  addresses_[key] = e;
+  address_updates_[key] = std::move(e);
+}
+
+void HostCache::forget_address(const std::string& url,
+                               curl::string_list* resolve) {
+  std::string host;
+  const auto key = host_key(url, &host);
+  if (key.empty()) return;
+
+  addresses_.erase(key);
+  address_updates_.erase(key);
+
+  resolve->reset();
+  resolve->append("-" + key);
+}
+
+void HostCache::save() {
+  try {
+    if (!address_updates_.empty())
+      disk_cache::store(addresses_path_, address_updates_, now_);
+    if (!session_updates_.empty())
+      disk_cache::store(sessions_path_, session_updates_, now_);
+  } catch (std::system_error&) {
+  }
+
+  address_updates_.clear();
+  session_updates_.clear();
+}
+
+}  // namespace ttyml
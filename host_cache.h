@@ -0,0 +1,61 @@
+#pragma once
+
+#include <ctime>
+#include <string>
+
+#include <curl/curl.h>
+
+#include "util/curl.h"
+#include "util/disk_cache.h"
+
+namespace ttyml {
+
+// Remembers resolved addresses and TLS sessions across invocations, so that
+// back-to-back runs against the same host skip DNS lookups and full TLS
+// handshakes.
+//
+// TLS sessions are only remembered when curl uses OpenSSL.
+class HostCache {
+ public:
+  // Loads the cache from `directory`, creating the directory if needed.
+  explicit HostCache(std::string directory);
+
+  // Returns the default cache directory.
+  static std::string default_directory();
+
+  // Configures `curl` to use what is known about the host of `url`.  Entries
+  // needed by CURLOPT_RESOLVE are added to `resolve`.  Returns true if a
+  // remembered address is used.
+  bool prepare(CURL* curl, const std::string& url, curl::string_list* resolve);
+
+  // Records the address connected to by a completed transfer of `url`.
+  void update(CURL* curl, const std::string& url);
+
+  // Forgets the remembered address of the host of `url`, for example because
+  // connecting to it failed.  Adds an entry to `resolve` that removes the
+  // address from curl's DNS cache.
+  void forget_address(const std::string& url, curl::string_list* resolve);
+
+  // Merges updates into the files on disk.
+  void save();
+
+ private:
+  // The time to live of resolved addresses, matching curl's own DNS cache.
+  static const std::time_t kAddressTtl = 60;
+
+  std::string addresses_path_;
+  std::string sessions_path_;
+
+  const std::time_t now_;
+
+  disk_cache::map addresses_;
+  disk_cache::map sessions_;
+
+  disk_cache::map address_updates_;
+  disk_cache::map session_updates_;
+
+  // OpenSSL callbacks for remembering and restoring TLS sessions.
+  struct Ssl;
+};
+
+}  // namespace ttyml
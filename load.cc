@@ -0,0 +1,457 @@
+// Runs many concurrent sessions against a ttyml server, filling in forms
+// from an answers file, and reports the latency of each step.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <getopt.h>
+
+#include <curl/curl.h>
+
+#include "ttyml.h"
+#include "util/curl.h"
+#include "util/document.h"
+#include "util/string.h"
+
+namespace {
+
+int print_version;
+int print_help;
+int use_checksum;
+
+unsigned long session_count = 100;
+unsigned long concurrency = 10;
+unsigned long thread_count = 0;
+
+std::string answers_path;
+
+struct option long_options[] = {
+    {"answers", required_argument, nullptr, 'a'},
+    {"checksum", no_argument, &use_checksum, 1},
+    {"concurrency", required_argument, nullptr, 'c'},
+    {"sessions", required_argument, nullptr, 'n'},
+    {"threads", required_argument, nullptr, 't'},
+    {"version", no_argument, &print_version, 1},
+    {"help", no_argument, &print_help, 1},
+    {nullptr, 0, nullptr, 0}};
+
+using Answers = std::unordered_map<std::string, std::string>;
+
+// Reads one set of answers per line, as tab separated name=value pairs.
+// Empty lines and lines starting with '#' are skipped.
+std::vector<Answers> read_answers(const std::string& path) {
+  std::ifstream input{path};
+  if (!input) throw std::runtime_error{string::cat("cannot open ", path)};
+
+  std::vector<Answers> result;
+
+  std::string line;
+  while (std::getline(input, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty() || line[0] == '#') continue;
+
+    result.emplace_back();
+    const auto pairs = string::split<std::vector<std::string>>(line, '\t');
+    for (const auto& pair : pairs) {
+      const auto equals = pair.find('=');
+      if (equals == std::string::npos)
+        throw std::runtime_error{
+            string::cat(path, ": expected name=value, got '", pair, "'")};
+      result.back()[pair.substr(0, equals)] = pair.substr(equals + 1);
+    }
+  }
+
+  if (input.bad())
+    throw std::runtime_error{string::cat("error reading ", path)};
+
+  return result;
+}
+
+// Returns the FNV-1a hash of the lines of `document`, with their styles.
+std::uint64_t checksum(const tty::Document& document) {
+  std::uint64_t result = UINT64_C(14695981039346656037);
+  std::string line;
+  for (size_t i = 0; i < document.size(); ++i) {
+    line.clear();
+    document.append_line(&line, i);
+    line.push_back('\n');
+    for (const auto ch : line) {
+      result ^= static_cast<unsigned char>(ch);
+      result *= UINT64_C(1099511628211);
+    }
+  }
+  return result;
+}
+
+// Measurements of one step of every session.  Step 0 is loading the first
+// page, and step n is submitting the n'th set of answers.
+struct Step {
+  std::vector<std::chrono::steady_clock::duration> latencies;
+  size_t errors = 0;
+
+  // Distinct checksums of the rendered pages, with --checksum.
+  std::set<std::uint64_t> checksums;
+
+  void merge(const Step& other) {
+    latencies.insert(latencies.end(), other.latencies.begin(),
+                     other.latencies.end());
+    errors += other.errors;
+    checksums.insert(other.checksums.begin(), other.checksums.end());
+  }
+};
+
+// One simulated user going through the form flow.
+struct VirtualSession {
+  ttyml::Session session;
+  tty::Document document;
+
+  std::unique_ptr<ttyml::Context> context;
+  std::chrono::steady_clock::time_point start;
+
+  // The number of forms submitted so far.
+  size_t step = 0;
+};
+
+void check(CURLMcode ret, const char* function) {
+  if (ret != CURLM_OK)
+    throw std::runtime_error{
+        string::cat(function, " failed: ", curl_multi_strerror(ret))};
+}
+
+// Takes one session from `remaining`, returning false if none are left.
+bool take(std::atomic<unsigned long>& remaining) {
+  auto n = remaining.load();
+  while (n && !remaining.compare_exchange_weak(n, n - 1)) {
+  }
+  return n != 0;
+}
+
+// Runs up to `concurrency` sessions at a time on one curl multi handle,
+// starting new ones until `remaining` reaches zero.  The multi handle pools
+// connections and resolved addresses for all of its sessions.
+class Worker {
+ public:
+  Worker(const std::string& url, const std::vector<Answers>& answers,
+         std::atomic<unsigned long>& remaining, unsigned long concurrency)
+      : url_{url},
+        answers_{answers},
+        remaining_{remaining},
+        concurrency_{concurrency},
+        multi_{curl_multi_init(), curl_multi_cleanup} {
+    if (!multi_) throw std::runtime_error{"curl_multi_init failed"};
+  }
+
+  ~Worker() {
+    for (const auto& session : sessions_) {
+      if (session && session->context)
+        curl_multi_remove_handle(multi_.get(), session->context->handle());
+    }
+  }
+
+  void run() {
+    sessions_.resize(concurrency_);
+    for (auto& session : sessions_) start(&session);
+
+    while (active_) {
+      int running;
+      check(curl_multi_perform(multi_.get(), &running), "curl_multi_perform");
+
+      int queued;
+      while (const auto message = curl_multi_info_read(multi_.get(), &queued)) {
+        if (message->msg != CURLMSG_DONE) continue;
+
+        std::unique_ptr<VirtualSession>* session;
+        curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &session);
+        check(curl_multi_remove_handle(multi_.get(), message->easy_handle),
+              "curl_multi_remove_handle");
+        complete(session, message->data.result);
+      }
+
+      if (active_)
+        check(curl_multi_poll(multi_.get(), nullptr, 0, 1000, nullptr),
+              "curl_multi_poll");
+    }
+  }
+
+  const std::vector<Step>& steps() const { return steps_; }
+
+  const std::string& first_error() const { return first_error_; }
+
+ private:
+  // Starts a new session in `slot`, if any remain.
+  void start(std::unique_ptr<VirtualSession>* slot) {
+    slot->reset();
+    if (!take(remaining_)) return;
+
+    *slot = std::make_unique<VirtualSession>();
+    (*slot)->session.document_ = &(*slot)->document;
+    ++active_;
+
+    send(slot, ttyml::Context::prepare((*slot)->session, url_.c_str()));
+  }
+
+  void send(std::unique_ptr<VirtualSession>* slot,
+            std::unique_ptr<ttyml::Context> context) {
+    auto& session = **slot;
+    session.context = std::move(context);
+    curl::setopt(session.context->handle(), CURLOPT_PRIVATE, slot);
+    session.start = std::chrono::steady_clock::now();
+    check(curl_multi_add_handle(multi_.get(), session.context->handle()),
+          "curl_multi_add_handle");
+  }
+
+  void complete(std::unique_ptr<VirtualSession>* slot, CURLcode result) {
+    auto& session = **slot;
+
+    if (steps_.size() <= session.step) steps_.resize(session.step + 1);
+    auto& step = steps_[session.step];
+
+    const auto latency = std::chrono::steady_clock::now() - session.start;
+
+    std::unique_ptr<ttyml::Context> next;
+    try {
+      // Redirects are followed with the same handle, as part of the step.
+      if (!session.context->finish(result)) {
+        check(curl_multi_add_handle(multi_.get(), session.context->handle()),
+              "curl_multi_add_handle");
+        return;
+      }
+
+      if (session.context->status_code() >= 400)
+        throw std::runtime_error{string::cat("server responded with status ",
+                                             session.context->status_code())};
+
+      if (use_checksum) step.checksums.emplace(checksum(session.document));
+      session.document.clear();
+
+      if (session.context->has_prompt() && session.step < answers_.size())
+        next = session.context->prepare_submit(answers_[session.step++]);
+    } catch (std::runtime_error& e) {
+      ++step.errors;
+      if (first_error_.empty()) first_error_ = e.what();
+    }
+
+    step.latencies.emplace_back(latency);
+
+    if (next) {
+      send(slot, std::move(next));
+      return;
+    }
+
+    --active_;
+    start(slot);
+  }
+
+  const std::string& url_;
+  const std::vector<Answers>& answers_;
+  std::atomic<unsigned long>& remaining_;
+  const unsigned long concurrency_;
+
+  std::unique_ptr<CURLM, decltype(&curl_multi_cleanup)> multi_;
+
+  // Each transfer refers to its slot through CURLOPT_PRIVATE, so the slots
+  // must not move once transfers have started.
+  std::vector<std::unique_ptr<VirtualSession>> sessions_;
+  unsigned long active_ = 0;
+
+  std::vector<Step> steps_;
+  std::string first_error_;
+};
+
+double milliseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// Returns the `p`th percentile of sorted `latencies` in milliseconds.
+double percentile(
+    const std::vector<std::chrono::steady_clock::duration>& latencies,
+    double p) {
+  auto rank = static_cast<size_t>(p / 100 * latencies.size() + 0.999999);
+  return milliseconds(latencies[std::max<size_t>(rank, 1) - 1]);
+}
+
+unsigned long parse_count(const char* program_name, const char* what,
+                          const char* arg) {
+  char* endptr = nullptr;
+  const auto result = std::strtoul(arg, &endptr, 10);
+  if (*endptr || !*arg || !result) {
+    std::cerr << program_name << ": invalid " << what << " '" << arg << "'\n";
+    std::exit(EXIT_FAILURE);
+  }
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) try {
+  const char* program_name = (argc > 0) ? argv[0] : "ttyml-load";
+
+  int i;
+  while ((i = getopt_long(argc, argv, "", long_options, 0)) != -1) {
+    switch (i) {
+      case 0:
+        break;
+
+      case 'a':
+        answers_path = optarg;
+        break;
+
+      case 'c':
+        concurrency = parse_count(program_name, "concurrency", optarg);
+        break;
+
+      case 'n':
+        session_count = parse_count(program_name, "session count", optarg);
+        break;
+
+      case 't':
+        thread_count = parse_count(program_name, "thread count", optarg);
+        break;
+
+      case '?':
+        std::cerr << "Try `" << program_name
+                  << " --help' for more information\n";
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (print_help) {
+    std::cout << "Usage: " << program_name << " [OPTION]... URL\n"
+              << "\n"
+              << "Runs sessions starting at URL, and reports the latency of "
+                 "each step.\n"
+              << "\n"
+              << "      --sessions=N     run N sessions in total (default "
+                 "100)\n"
+              << "      --concurrency=N  run N sessions at a time (default "
+                 "10)\n"
+              << "      --threads=N      spread the sessions over N threads "
+                 "(default: one per\n"
+              << "                       core)\n"
+              << "      --answers=FILE   submit forms with the answers in "
+                 "FILE, one form per\n"
+              << "                       line as tab separated name=value "
+                 "pairs\n"
+              << "      --checksum       report the number of distinct pages "
+                 "seen at each step\n"
+              << "      --help           display this help and exit\n"
+              << "      --version        display version information\n"
+              << "\n"
+              << "Report bugs to <morten.hustveit@gmail.com>\n";
+    return EXIT_SUCCESS;
+  }
+
+  if (print_version) {
+    std::cout << PACKAGE_STRING << '\n';
+    return EXIT_SUCCESS;
+  }
+
+  if (optind + 1 != argc) {
+    std::cerr << "Usage: " << program_name << " [OPTION]... URL\n";
+    return EXIT_FAILURE;
+  }
+
+  const std::string url = argv[optind++];
+
+  std::vector<Answers> answers;
+  if (!answers_path.empty()) answers = read_answers(answers_path);
+
+  if (!thread_count)
+    thread_count = std::max(1U, std::thread::hardware_concurrency());
+  thread_count = std::min(thread_count, concurrency);
+
+  curl::check(curl_global_init(CURL_GLOBAL_DEFAULT), "curl_global_init");
+
+  std::atomic<unsigned long> remaining{session_count};
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  for (unsigned long i = 0; i < thread_count; ++i) {
+    workers.emplace_back(std::make_unique<Worker>(
+        url, answers, remaining,
+        concurrency / thread_count + (i < concurrency % thread_count)));
+  }
+
+  std::vector<std::exception_ptr> exceptions(workers.size());
+  std::vector<std::thread> threads;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < workers.size(); ++i) {
+    threads.emplace_back([&workers, &exceptions, i] {
+      try {
+        workers[i]->run();
+      } catch (...) {
+        exceptions[i] = std::current_exception();
+      }
+    });
+  }
+
+  for (auto& thread : threads) thread.join();
+
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  for (const auto& exception : exceptions)
+    if (exception) std::rethrow_exception(exception);
+
+  std::vector<Step> steps;
+  std::string first_error;
+  for (const auto& worker : workers) {
+    if (steps.size() < worker->steps().size())
+      steps.resize(worker->steps().size());
+    for (size_t i = 0; i < worker->steps().size(); ++i)
+      steps[i].merge(worker->steps()[i]);
+    if (first_error.empty()) first_error = worker->first_error();
+  }
+
+  size_t requests = 0, errors = 0;
+
+  std::printf("%4s %9s %7s %9s %9s %9s %9s%s\n", "step", "requests", "errors",
+              "p50 ms", "p90 ms", "p99 ms", "max ms",
+              use_checksum ? "  pages" : "");
+  for (size_t i = 0; i < steps.size(); ++i) {
+    auto& step = steps[i];
+    std::sort(step.latencies.begin(), step.latencies.end());
+
+    requests += step.latencies.size();
+    errors += step.errors;
+
+    std::printf("%4zu %9zu %7zu %9.2f %9.2f %9.2f %9.2f", i,
+                step.latencies.size(), step.errors,
+                percentile(step.latencies, 50), percentile(step.latencies, 90),
+                percentile(step.latencies, 99),
+                milliseconds(step.latencies.back()));
+    if (use_checksum) std::printf("  %5zu", step.checksums.size());
+    std::printf("\n");
+  }
+
+  const auto seconds = std::chrono::duration<double>(elapsed).count();
+  std::printf("\n%zu requests in %.2f s, %.1f requests/s, %zu errors\n",
+              requests, seconds, requests / seconds, errors);
+  if (!first_error.empty())
+    std::printf("First error: %s\n", first_error.c_str());
+
+  curl_global_cleanup();
+
+  return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+} catch (std::runtime_error& e) {
+  std::cerr << "Fatal error: " << e.what() << '\n';
+  return EXIT_FAILURE;
+}
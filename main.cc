@@ -2,20 +2,262 @@
 #include "config.h"
 #endif
 
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <initializer_list>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
 
 #include <getopt.h>
+#include <unistd.h>
 
+#include <readline/readline.h>
+
+#include "daemon.h"
+#include "host_cache.h"
 #include "ttyml.h"
+#include "util/curl.h"
+#include "util/document.h"
+#include "util/pager.h"
+#include "util/recording.h"
+#include "util/string.h"
+#include "util/trace.h"
 
 namespace {
 
 int print_version;
 int print_help;
+int run_client;
+int run_daemon;
+int use_host_cache;
+int use_pager;
+int no_fast_xml;
+int replay_fast;
+
+double watch_interval;
+
+std::string ca_file;
+std::string output_format = "auto";
+std::string record_path;
+std::string replay_path;
+std::string socket_path;
+std::string trace_path;
+
+struct option long_options[] = {
+    {"cacert", required_argument, nullptr, 'C'},
+    {"client", no_argument, &run_client, 1},
+    {"daemon", no_argument, &run_daemon, 1},
+    {"host-cache", no_argument, &use_host_cache, 1},
+    {"no-fast-xml", no_argument, &no_fast_xml, 1},
+    {"output", required_argument, nullptr, 'o'},
+    {"pager", no_argument, &use_pager, 1},
+    {"record", required_argument, nullptr, 'r'},
+    {"replay", required_argument, nullptr, 'R'},
+    {"replay-fast", no_argument, &replay_fast, 1},
+    {"socket", required_argument, nullptr, 's'},
+    {"trace", required_argument, nullptr, 'T'},
+    {"watch", required_argument, nullptr, 'w'},
+    {"version", no_argument, &print_version, 1},
+    {"help", no_argument, &print_help, 1},
+    {nullptr, 0, nullptr, 0}};
+
+// Writes `text` on the last line of the terminal, which is kept free of the
+// page, or clears the line if `text` is empty.
+void show_status(std::string* output, const std::string& text,
+                 unsigned int columns, unsigned int lines) {
+  if (lines == 0) {
+    if (!text.empty()) std::cerr << text << '\n';
+    return;
+  }
+
+  // Save the cursor, write the line, and restore the cursor.
+  output->append(string::cat("\0337\033[", lines, ";1H\033[2K"));
+  auto length = text.find('\n');
+  if (length == std::string::npos) length = text.size();
+  if (columns > 0 && length > columns) length = columns;
+  output->append(text, 0, length);
+  output->append("\0338");
+}
+
+// Reloads `url` every `watch_interval` seconds, redrawing only the parts of
+// the terminal that changed.  If a reload fails, the last page stays on
+// the screen with the error below it, until a later reload succeeds.
+void watch(ttyml::Session& session, const char* url) {
+  tty::Screen previous, current;
+
+  session.screen_ = &current;
+  session.conditional_ = true;
+
+  std::string output;
+  bool first = true;
 
-struct option long_options[] = {{"version", no_argument, &print_version, 1},
-                                {"help", no_argument, &print_help, 1},
-                                {nullptr, 0, nullptr, 0}};
+  // The error shown on the last line, if any.
+  std::string error;
+
+  // The height of the terminal at the last reload.
+  unsigned int previous_lines = 0;
+
+  for (;;) {
+    unsigned int columns = 0, lines = 0;
+    tty::window_size(STDOUT_FILENO, &columns, &lines);
+
+    // Start over if the terminal was resized.
+    if (columns != previous.columns_ || lines != previous_lines) {
+      first = true;
+      session.validators_.clear();
+    }
+    previous_lines = lines;
+
+    current.columns_ = columns;
+    current.rows_.clear();
+
+    output.clear();
+
+    std::unique_ptr<ttyml::Context> context;
+    try {
+      context = std::make_unique<ttyml::Context>(session, url);
+    } catch (std::runtime_error& e) {
+      auto message = string::cat("Error: ", e.what());
+      if (message != error) {
+        error = std::move(message);
+        show_status(&output, error, columns, lines);
+      }
+    }
+
+    if (context && !context->not_modified()) {
+      if (lines > 0 && current.rows_.size() >= lines)
+        current.rows_.resize(lines - 1);
+
+      if (first) {
+        output.append("\033[H\033[2J");
+        tty::diff(&output, tty::Screen{}, current);
+        error.clear();
+      } else {
+        tty::diff(&output, previous, current);
+      }
+      first = false;
+
+      std::swap(previous, current);
+    }
+
+    if (context && !error.empty()) {
+      show_status(&output, "", columns, lines);
+      error.clear();
+    }
+
+    std::cout.write(output.data(), output.size());
+    std::cout.flush();
+    if (std::cout.bad())
+      throw std::runtime_error{"write to standard output failed"};
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(watch_interval));
+  }
+}
+
+// Shows the lines collected for the pager, paging them if they do not fit on
+// the terminal.
+void show(ttyml::Session& session) {
+  if (!session.document_ || session.document_->empty()) return;
+
+  auto& document = *session.document_;
+
+  unsigned int columns = 0, lines = 0;
+  tty::window_size(STDOUT_FILENO, &columns, &lines);
+
+  std::cout.flush();
+
+  if (lines > 0 && document.size() >= lines) {
+    tty::Pager{document, STDIN_FILENO, STDOUT_FILENO}.run();
+  } else {
+    std::string output;
+    for (size_t i = 0; i < document.size(); ++i) {
+      document.append_line(&output, i);
+      output.push_back('\n');
+    }
+    std::cout.write(output.data(), output.size());
+    std::cout.flush();
+  }
+
+  document.clear();
+}
+
+// Returns the name of the first of `options` that was given, or nullptr if
+// none was.
+const char* first_given(
+    std::initializer_list<std::pair<const char*, bool>> options) {
+  for (const auto& option : options) {
+    if (option.second) return option.first;
+  }
+  return nullptr;
+}
+
+// Runs an interactive session starting at `url`.  The session's CA file and
+// parser are set by the caller.
+int run(ttyml::Session& session, const char* url,
+        const ttyml::ClientOptions& options) {
+  auto result = EXIT_SUCCESS;
+
+  using OutputFormat = ttyml::Session::OutputFormat;
+
+  const auto& output_format = options.output_format_;
+  if (output_format == "terminal" ||
+      (output_format == "auto" && isatty(STDOUT_FILENO)))
+    session.output_format_ = OutputFormat::Terminal;
+  else if (output_format == "jsonl")
+    session.output_format_ = OutputFormat::Jsonl;
+  else
+    session.output_format_ = OutputFormat::Plain;
+
+  tty::OutputBuffer output{STDOUT_FILENO};
+  session.output_ =
+      (session.output_format_ != OutputFormat::Terminal) ? &output : nullptr;
+
+  // Keep prompts out of machine readable output.
+  rl_outstream =
+      (session.output_format_ == OutputFormat::Jsonl) ? stderr : stdout;
+
+  // The pager needs a terminal to read keys from and draw on.
+  tty::Document document;
+  session.document_ = (options.pager_ &&
+                       session.output_format_ == OutputFormat::Terminal &&
+                       isatty(STDIN_FILENO) && isatty(STDOUT_FILENO))
+                          ? &document
+                          : nullptr;
+
+  try {
+    auto context = std::make_unique<ttyml::Context>(session, url);
+    show(session);
+
+    while (context && context->has_prompt()) {
+      context = context->next_context();
+      show(session);
+    }
+  } catch (std::runtime_error& e) {
+    show(session);
+    std::cerr << "Fatal error: " << e.what() << '\n';
+    result = EXIT_FAILURE;
+  }
+
+  session.document_ = nullptr;
+  session.output_ = nullptr;
+
+  try {
+    output.flush();
+  } catch (std::runtime_error& e) {
+    std::cerr << "Fatal error: " << e.what() << '\n';
+    result = EXIT_FAILURE;
+  }
+
+  if (session.host_cache_) session.host_cache_->save();
+
+  return result;
+}
 
 }  // namespace
 
@@ -28,6 +270,46 @@ int main(int argc, char** argv) try {
       case 0:
         break;
 
+      case 'C':
+        ca_file = optarg;
+        break;
+
+      case 'o':
+        output_format = optarg;
+        if (output_format != "auto" && output_format != "terminal" &&
+            output_format != "plain" && output_format != "jsonl") {
+          std::cerr << program_name << ": invalid output format '" << optarg
+                    << "'\n";
+          return EXIT_FAILURE;
+        }
+        break;
+
+      case 'r':
+        record_path = optarg;
+        break;
+
+      case 'R':
+        replay_path = optarg;
+        break;
+
+      case 's':
+        socket_path = optarg;
+        break;
+
+      case 'T':
+        trace_path = optarg;
+        break;
+
+      case 'w': {
+        char* endptr = nullptr;
+        watch_interval = std::strtod(optarg, &endptr);
+        if (*endptr || !(watch_interval > 0)) {
+          std::cerr << program_name << ": invalid watch interval '" << optarg
+                    << "'\n";
+          return EXIT_FAILURE;
+        }
+      } break;
+
       case '?':
         std::cerr << "Try `" << program_name
                   << " --help' for more information\n";
@@ -38,8 +320,40 @@ int main(int argc, char** argv) try {
   if (print_help) {
     std::cout << "Usage: " << program_name << " [OPTION]... URL\n"
               << "\n"
-              << "      --help     display this help and exit\n"
-              << "      --version  display version information\n"
+              << "      --output=FORMAT  write lines for a 'terminal', as "
+                 "'plain' text, or as\n"
+              << "                       'jsonl' events; the default is "
+                 "'terminal' when\n"
+              << "                       standard output is a terminal, and "
+                 "'plain' otherwise\n"
+              << "      --pager          show pages longer than the terminal "
+                 "in a pager\n"
+              << "      --watch=SECONDS  reload the page periodically, "
+                 "redrawing only changes\n"
+              << "      --host-cache     remember resolved addresses and TLS "
+                 "sessions between\n"
+              << "                       invocations\n"
+              << "      --cacert=FILE    verify servers against the "
+                 "certificates in FILE\n"
+              << "      --record=FILE    save all requests and responses to "
+                 "FILE\n"
+              << "      --replay=FILE    take responses from a file saved with "
+                 "--record instead\n"
+              << "                       of the network, with the original "
+                 "timing\n"
+              << "      --replay-fast    replay responses without waiting\n"
+              << "      --trace=FILE     write Chrome trace events for "
+                 "parsing and rendering to\n"
+              << "                       FILE\n"
+              << "      --no-fast-xml    parse every page with Expat\n"
+              << "      --daemon         serve sessions for --client, keeping "
+                 "connections warm\n"
+              << "      --client         run the session in a daemon started "
+                 "with --daemon,\n"
+              << "                       if one is running\n"
+              << "      --socket=PATH    socket used by --daemon and --client\n"
+              << "      --help           display this help and exit\n"
+              << "      --version        display version information\n"
               << "\n"
               << "Report bugs to <morten.hustveit@gmail.com>\n";
     return EXIT_SUCCESS;
@@ -50,6 +364,122 @@ int main(int argc, char** argv) try {
     return EXIT_SUCCESS;
   }
 
+  if (socket_path.empty()) socket_path = ttyml::default_socket_path();
+
+#ifdef ENABLE_TRACE
+  std::unique_ptr<trace::recorder> tracer;
+  if (!trace_path.empty()) {
+    tracer = std::make_unique<trace::recorder>(trace_path);
+    trace::current() = tracer.get();
+  }
+#else
+  if (!trace_path.empty()) {
+    std::cerr << program_name
+              << ": --trace needs a build configured with --enable-trace\n";
+    return EXIT_FAILURE;
+  }
+#endif
+
+  // Sessions run by the daemon take their options from the client, which
+  // passes on only --output, --pager, --cacert and --no-fast-xml.
+  const auto session_option =
+      first_given({{"--output", output_format != "auto"},
+                   {"--pager", use_pager},
+                   {"--cacert", !ca_file.empty()},
+                   {"--no-fast-xml", no_fast_xml},
+                   {"--record", !record_path.empty()},
+                   {"--replay", !replay_path.empty()},
+                   {"--replay-fast", replay_fast},
+                   {"--host-cache", use_host_cache},
+                   {"--watch", watch_interval > 0}});
+  if (run_daemon && session_option) {
+    std::cerr << program_name << ": " << session_option
+              << " applies to sessions, so give it to --client, not --daemon\n";
+    return EXIT_FAILURE;
+  }
+
+  const auto local_option = first_given({{"--record", !record_path.empty()},
+                                         {"--replay", !replay_path.empty()},
+                                         {"--replay-fast", replay_fast},
+                                         {"--host-cache", use_host_cache},
+                                         {"--trace", !trace_path.empty()}});
+  if (run_client && local_option) {
+    std::cerr << program_name << ": " << local_option
+              << " cannot be combined with --client\n";
+    return EXIT_FAILURE;
+  }
+
+  // Watching draws on the terminal itself, and runs until interrupted, so
+  // it never gets to save the host cache or finish the trace.
+  const auto unwatched_option =
+      first_given({{"--client", run_client},
+                   {"--output", output_format != "auto"},
+                   {"--pager", use_pager},
+                   {"--host-cache", use_host_cache},
+                   {"--trace", !trace_path.empty()}});
+  if (watch_interval > 0 && unwatched_option) {
+    std::cerr << program_name << ": " << unwatched_option
+              << " cannot be combined with --watch\n";
+    return EXIT_FAILURE;
+  }
+
+  ttyml::ClientOptions options;
+  options.output_format_ = output_format;
+  options.pager_ = use_pager;
+  options.ca_file_ = ca_file;
+  options.fast_xml_ = !no_fast_xml;
+
+  curl::share share;
+  share.add(CURL_LOCK_DATA_DNS);
+  share.add(CURL_LOCK_DATA_SSL_SESSION);
+  share.add(CURL_LOCK_DATA_CONNECT);
+
+  ttyml::Session session;
+  session.share_ = share.get();
+  session.ca_file_ = options.ca_file_;
+  session.fast_xml_ = options.fast_xml_;
+
+  std::unique_ptr<recording::writer> recorder;
+  if (!record_path.empty()) {
+    recorder = std::make_unique<recording::writer>(record_path);
+    session.recorder_ = recorder.get();
+  }
+
+  std::unique_ptr<recording::player> player;
+  if (!replay_path.empty()) {
+    player = std::make_unique<recording::player>(recording::load(replay_path));
+    session.player_ = player.get();
+    session.replay_delays_ = !replay_fast;
+  }
+
+  std::unique_ptr<ttyml::HostCache> host_cache;
+  if (use_host_cache) {
+    host_cache = std::make_unique<ttyml::HostCache>(
+        ttyml::HostCache::default_directory());
+    session.host_cache_ = host_cache.get();
+  }
+
+  if (run_daemon) {
+    if (optind != argc) {
+      std::cerr << "Usage: " << program_name << " --daemon [OPTION]...\n";
+      return EXIT_FAILURE;
+    }
+
+    // Clients share connections, and nothing else.
+    ttyml::serve(socket_path, [&share](const char* url,
+                                       const ttyml::ClientOptions& options) {
+      ttyml::Session session;
+      session.share_ = share.get();
+      session.ca_file_ = options.ca_file_;
+      if (!session.ca_file_.empty() && session.ca_file_[0] != '/')
+        session.ca_file_ =
+            string::cat(options.working_directory_, '/', options.ca_file_);
+      session.fast_xml_ = options.fast_xml_;
+      session.working_directory_ = options.working_directory_;
+      return run(session, url, options);
+    });
+  }
+
   if (optind + 1 != argc) {
     std::cerr << "Usage: " << program_name << " [OPTION]... URL\n";
     return EXIT_FAILURE;
@@ -57,12 +487,33 @@ int main(int argc, char** argv) try {
 
   const char* url = argv[optind++];
 
-  auto context = std::make_unique<ttyml::Context>(url);
+  if (watch_interval > 0) {
+    watch(session, url);
+    return EXIT_SUCCESS;
+  }
+
+  if (run_client) {
+    // The daemon runs in a directory of its own.
+    auto client_options = options;
+    std::unique_ptr<char, decltype(&free)> cwd{getcwd(nullptr, 0), free};
+    if (!cwd) throw std::system_error{errno, std::system_category(), "getcwd"};
+    client_options.working_directory_ = cwd.get();
+
+    int exit_status;
+    if (ttyml::forward(socket_path, url, client_options, &exit_status))
+      return exit_status;
+  }
+
+  const auto result = run(session, url, options);
 
-  while (context && context->has_prompt()) {
-    context = context->next_context();
+#ifdef ENABLE_TRACE
+  if (tracer) {
+    trace::current() = nullptr;
+    tracer->close();
   }
+#endif
 
+  return result;
 } catch (std::runtime_error& e) {
   std::cerr << "Fatal error: " << e.what() << '\n';
   return EXIT_FAILURE;
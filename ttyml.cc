@@ -4,16 +4,19 @@
 
 #include "ttyml.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <exception>
 #include <memory>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 
-#ifdef HAVE_SYS_IOCTL_H
-#include <sys/ioctl.h>
-#endif
-
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -22,10 +25,14 @@
 #include <expat.h>
 #include <readline/readline.h>
 
+#include "host_cache.h"
 #include "util/curl.h"
+#include "util/json.h"
 #include "util/string.h"
+#include "util/trace.h"
 #include "util/tty.h"
 #include "util/url.h"
+#include "validator.h"
 
 #define NS_PREFIX "https://ttyml.org/2018/05/26|"
 
@@ -33,6 +40,8 @@
   do {                                                                        \
     const auto ret = (call);                                                  \
     if (ret == XML_STATUS_OK) break;                                          \
+    if (pending_exception_) std::rethrow_exception(pending_exception_);       \
+    check_parser_memory();                                                    \
     throw std::runtime_error{string::cat(                                     \
         "line ", XML_GetCurrentLineNumber(xml_parser_.get()), ", column ",    \
         XML_GetCurrentColumnNumber(xml_parser_.get()), ", offset ",           \
@@ -45,10 +54,14 @@ namespace ttyml {
 
 const std::unordered_map<std::string, Context::Element>
     Context::tag_to_element_s{{
+        {NS_PREFIX "cell", Element::Cell},
         {NS_PREFIX "form", Element::Form},
         {NS_PREFIX "line", Element::Line},
+        {NS_PREFIX "option", Element::Option},
         {NS_PREFIX "prompt", Element::Prompt},
+        {NS_PREFIX "row", Element::Row},
         {NS_PREFIX "style", Element::Style},
+        {NS_PREFIX "table", Element::Table},
         {NS_PREFIX "ttyml", Element::Root},
         {NS_PREFIX "var", Element::Var},
     }};
@@ -67,86 +80,609 @@ unsigned int parse_color(const char* value) {
   return result;
 }
 
-Context::Context(const char* url, const char* method, const char* data)
-    : url_{url},
+// Makes any style transition pending in `writer`, so that traces show what
+// transitions cost apart from the text they precede.
+void apply_style(tty::Writer* writer) {
+  if (!writer->style_pending()) return;
+  TRACE_SPAN("Writer::transition");
+  writer->apply_style();
+}
+
+// Returns roughly the number of states a regular expression compiles to,
+// counting each counted repetition as copies of what it repeats, or
+// `limit + 1` if that is more than `limit`.
+size_t regex_size(const std::string& pattern, size_t limit) {
+  const auto cap = [limit](size_t value) { return std::min(value, limit + 1); };
+
+  // The sizes of the open groups, and of the last atom.
+  std::vector<size_t> groups{0};
+  size_t last = 0;
+
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    switch (pattern[i]) {
+      case '(':
+        groups.emplace_back(0);
+        continue;
+
+      case ')':
+        if (groups.size() == 1) break;
+        last = groups.back();
+        groups.pop_back();
+        groups.back() = cap(groups.back() + last);
+        continue;
+
+      case '[':
+        // A bracket expression matches one character.
+        for (++i; i < pattern.size() && pattern[i] != ']'; ++i) {
+          if (pattern[i] == '\\') ++i;
+        }
+        break;
+
+      case '\\':
+        ++i;
+        break;
+
+      case '{': {
+        // {n}, {n,} or {n,m}.
+        char* endptr = nullptr;
+        size_t count = cap(std::strtoul(pattern.c_str() + i + 1, &endptr, 10));
+        if (*endptr == ',' && endptr[1] == '}') {
+          count = cap(count + 1);
+          ++endptr;
+        } else if (*endptr == ',') {
+          count = std::max(count, cap(std::strtoul(endptr + 1, &endptr, 10)));
+        }
+        i = endptr - pattern.c_str();
+        if (count) {
+          groups.back() = cap(groups.back() + last * (count - 1));
+          last = cap(last * count);
+        }
+        continue;
+      }
+    }
+
+    last = 1;
+    groups.back() = cap(groups.back() + 1);
+  }
+
+  return groups[0];
+}
+
+const Context::Prompt* Context::completing_prompt_s;
+Session* Context::completing_session_s;
+
+struct Context::Validation {
+  explicit Validation(const Context& context)
+      : context_{context},
+        validator_{context.session_.share_, context.session_.ca_file_} {}
+
+  // Reports the outcome of completed checks, noting the answers the server
+  // rejected.  If `editing` is true, readline is waiting for input, and the
+  // line being edited is drawn again below the messages.
+  void report(const std::vector<Validator::Result>& results, bool editing);
+
+  const Context& context_;
+  Validator validator_;
+
+  // The prompts whose answers were rejected, to be asked again.
+  std::vector<size_t> rejected_;
+};
+
+Context::Validation* Context::validation_s;
+
+thread_local Context::ParserMemory* Context::parser_memory_s;
+
+// Each allocation starts with the page it is charged to, and its size.
+struct alignas(std::max_align_t) ParserBlock {
+  void* memory;
+  size_t size;
+};
+
+class Context::ParserMemoryScope {
+ public:
+  explicit ParserMemoryScope(ParserMemory* memory) : saved_{parser_memory_s} {
+    parser_memory_s = memory;
+  }
+
+  ~ParserMemoryScope() { parser_memory_s = saved_; }
+
+  ParserMemoryScope(const ParserMemoryScope&) = delete;
+  ParserMemoryScope& operator=(const ParserMemoryScope&) = delete;
+
+ private:
+  ParserMemory* const saved_;
+};
+
+void* Context::parser_malloc(size_t size) {
+  // Every call into Expat that may allocate is made in a ParserMemoryScope.
+  const auto memory = parser_memory_s;
+  if (!memory) return nullptr;
+
+  if (size > memory->limit_ - memory->used_) {
+    memory->exceeded_ = true;
+    return nullptr;
+  }
+
+  const auto block =
+      static_cast<ParserBlock*>(std::malloc(sizeof(ParserBlock) + size));
+  if (!block) return nullptr;
+  block->memory = memory;
+  block->size = size;
+  memory->used_ += size;
+
+  return block + 1;
+}
+
+void* Context::parser_realloc(void* ptr, size_t size) {
+  if (!ptr) return parser_malloc(size);
+
+  auto block = static_cast<ParserBlock*>(ptr) - 1;
+  const auto memory = static_cast<ParserMemory*>(block->memory);
+  const auto old_size = block->size;
+  if (size > old_size && size - old_size > memory->limit_ - memory->used_) {
+    memory->exceeded_ = true;
+    return nullptr;
+  }
+
+  block = static_cast<ParserBlock*>(
+      std::realloc(block, sizeof(ParserBlock) + size));
+  if (!block) return nullptr;
+  block->size = size;
+  memory->used_ = memory->used_ - old_size + size;
+
+  return block + 1;
+}
+
+void Context::parser_free(void* ptr) {
+  if (!ptr) return;
+
+  const auto block = static_cast<ParserBlock*>(ptr) - 1;
+  static_cast<ParserMemory*>(block->memory)->used_ -= block->size;
+  std::free(block);
+}
+
+char* Context::complete_option(const char* text, int state) {
+  static std::pair<size_t, size_t> range;
+
+  const auto& completions =
+      completing_prompt_s->completions(*completing_session_s);
+  if (!state) range = completions.find_prefix(text);
+  if (range.first == range.second) return nullptr;
+
+  return strdup(completions[range.first++]);
+}
+
+char** Context::complete(const char* text, int start, int end) {
+  if (!completing_prompt_s || !completing_prompt_s->has_completions())
+    return nullptr;
+
+  rl_attempted_completion_over = 1;
+  rl_completion_append_character = 0;
+
+  try {
+    completing_prompt_s->completions(*completing_session_s);
+  } catch (std::runtime_error& e) {
+    std::cerr << "\nError: " << e.what() << '\n';
+    rl_on_new_line();
+    return nullptr;
+  }
+
+  return rl_completion_matches(text, complete_option);
+}
+
+int Context::resolve_completion_path(char** path) {
+  if (!completing_session_s || (*path)[0] == '/') return 0;
+
+  const auto resolved =
+      string::cat(completing_session_s->working_directory_, '/', *path);
+  std::free(*path);
+  *path = strdup(resolved.c_str());
+  return 1;
+}
+
+void Context::Validation::report(
+    const std::vector<Validator::Result>& results, bool editing) {
+  for (const auto& result : results) {
+    if (!result.valid_) rejected_.emplace_back(result.index_);
+    if (result.valid_ && result.message_.empty()) continue;
+
+    const auto& prompt = context_.prompts_[result.index_];
+
+    auto message = result.message_;
+    if (message.empty()) {
+      message = prompt.filter_message_.empty() ? "Invalid input."
+                                               : prompt.filter_message_;
+    }
+
+    if (editing) {
+      rl_clear_visible_line();
+      std::fflush(rl_outstream);
+    }
+
+    std::cerr << prompt.name_ << ": " << message << '\n';
+
+    if (editing) {
+      rl_on_new_line();
+      rl_redisplay();
+    }
+  }
+}
+
+int Context::report_checks() {
+  try {
+    validation_s->report(validation_s->validator_.poll(), true);
+  } catch (std::runtime_error& e) {
+    std::cerr << "\nError: " << e.what() << '\n';
+    rl_on_new_line();
+    rl_redisplay();
+  }
+
+  return 0;
+}
+
+const completion::sorted_list& Context::Prompt::completions(
+    Session& session) const {
+  if (!completions_) {
+    auto options = options_;
+    if (!options_url_.empty())
+      options.append(fetch_text(session, options_url_));
+    completions_ =
+        std::make_unique<completion::sorted_list>(std::move(options));
+  }
+
+  return *completions_;
+}
+
+Context::Context(Session& session, const char* url, const char* method,
+                 const char* data)
+    : Context{session, url, method, data ? data : "", std::vector<FormField>{},
+              true} {}
+
+Context::Context(Session& session, const char* url,
+                 std::vector<FormField> fields)
+    : Context{session, url, "POST", std::string{}, std::move(fields), true} {}
+
+Context::Context(Session& session, const char* url, const char* method,
+                 std::string body, std::vector<FormField> fields, bool perform)
+    : session_{session},
+      url_{url},
+      request_method_{method},
       curl_{curl_easy_init(), curl_easy_cleanup},
-      xml_parser_{nullptr, XML_ParserFree},
-      action_{url} {
+      mime_{nullptr, curl_mime_free},
+      xml_parser_{nullptr, XML_ParserFree} {
   if (!curl_) throw std::runtime_error{"curl_easy_init() failed"};
 
-  curl::string_list headers;
-  headers.append("Accept: text/ttyml");
-
-#ifdef HAVE_SYS_IOCTL_H
-  winsize stdout_winsize;
-  memset(&stdout_winsize, 0, sizeof(stdout_winsize));
-  if (-1 != ioctl(STDOUT_FILENO, TIOCGWINSZ, &stdout_winsize)) {
-    if (stdout_winsize.ws_col > 0)
-      headers.append(string::cat("Tty-Columns: ", stdout_winsize.ws_col));
-    if (stdout_winsize.ws_row > 0)
-      headers.append(string::cat("Tty-Lines: ", stdout_winsize.ws_row));
+  // Go straight to where permanently moved pages are now.
+  for (;;) {
+    const auto redirect = session_.permanent_redirects_.find(url_);
+    if (redirect == session_.permanent_redirects_.end() ||
+        !(request_method_ == "GET" || redirect->second.keep_method_))
+      break;
+    if (++redirects_ > kMaxRedirects)
+      throw std::runtime_error{string::cat("too many redirects from ", url)};
+    url_ = redirect->second.location_;
   }
-#endif
 
-  curl::setopt(curl_.get(), CURLOPT_URL, url);
-  curl::setopt(curl_.get(), CURLOPT_ACCEPT_ENCODING, "gzip,deflate");
-  curl::setopt(curl_.get(), CURLOPT_USERAGENT, PACKAGE_STRING);
-  curl::setopt(curl_.get(), CURLOPT_HTTPHEADER, headers.get());
+  action_ = url_;
+
+  set_headers();
+
+  curl::set_session_options(curl_.get(), session_.share_, session_.ca_file_,
+                            PACKAGE_STRING);
+  curl::setopt(curl_.get(), CURLOPT_URL, url_.c_str());
+
+  set_body(method, std::move(body), fields);
+
   curl::setopt(curl_.get(), CURLOPT_HEADERDATA, this);
   curl::setopt(curl_.get(), CURLOPT_HEADERFUNCTION,
                +[](const void* ptr, size_t size, size_t nmemb,
                    void* void_context) -> size_t {
                  const auto context = static_cast<Context*>(void_context);
-                 if (!context->wrap_exception(
-                         [=] { context->put_header(ptr, size * nmemb); }))
+                 if (!context->wrap_exception([=] {
+                       context->record(true, ptr, size * nmemb);
+                       context->put_header(ptr, size * nmemb);
+                     }))
                    return 0;
                  return nmemb;
                });
 
   curl::setopt(curl_.get(), CURLOPT_WRITEDATA, this);
-  curl::setopt(
-      curl_.get(), CURLOPT_WRITEFUNCTION,
-      +[](const void* ptr, size_t size, size_t nmemb,
-          void* void_context) -> size_t {
-        const auto context = static_cast<Context*>(void_context);
-        if (!context->wrap_exception([=] { context->put(ptr, size * nmemb); }))
-          return 0;
-        return nmemb;
-      });
-
-  const auto curl_ret = curl_easy_perform(curl_.get());
+  curl::setopt(curl_.get(), CURLOPT_WRITEFUNCTION,
+               +[](const void* ptr, size_t size, size_t nmemb,
+                   void* void_context) -> size_t {
+                 const auto context = static_cast<Context*>(void_context);
+                 if (!context->wrap_exception([=] {
+                       context->record(false, ptr, size * nmemb);
+                       context->put(ptr, size * nmemb);
+                     }))
+                   return 0;
+                 return nmemb;
+               });
+
+  begin_exchange();
+  if (perform) transfer();
+}
+
+std::string Context::fetch_text(Session& session, const std::string& url) {
+  std::string result;
+
+  Context context{session, url.c_str(), "GET", std::string{},
+                  std::vector<FormField>{}, false};
+  context.text_ = &result;
+  context.set_headers();
+  context.transfer();
+
+  return result;
+}
+
+void Context::transfer() {
+  for (;;) {
+    TRACE_SPAN("Context::transfer");
+
+    auto result = CURLE_OK;
+    if (session_.player_)
+      replay(session_.player_->next(request_method_, url_));
+    else
+      result = perform_transfer();
+
+    if (finish(result)) break;
+  }
+}
+
+std::unique_ptr<Context> Context::prepare(Session& session, const char* url,
+                                          const char* method,
+                                          const char* data) {
+  return std::unique_ptr<Context>{new Context{session, url, method,
+                                              data ? data : "",
+                                              std::vector<FormField>{}, false}};
+}
+
+bool Context::finish(CURLcode result) {
   if (pending_exception_) std::rethrow_exception(pending_exception_);
-  if (curl_ret != CURLE_OK)
-    throw std::runtime_error{string::cat("curl_easy_perform failed: ",
-                                         curl_easy_strerror(curl_ret))};
+  if (result != CURLE_OK)
+    throw std::runtime_error{
+        string::cat("transfer failed: ", curl_easy_strerror(result))};
 
-  if (xml_parser_) {
-    XML_Parse(xml_parser_.get(), nullptr, 0, 1);
-    if (pending_exception_) std::rethrow_exception(pending_exception_);
+  if (recording_) {
+    recording_->duration_us = microseconds_since_start();
+    session_.recorder_->write(*recording_);
+    recording_.reset();
+  }
+
+  if (session_.host_cache_ && !session_.player_)
+    session_.host_cache_->update(curl_.get(), url_);
+
+  if (follow_redirect()) return false;
+
+  end_document();
+  return true;
+}
+
+void Context::set_headers() {
+  headers_.reset();
+  headers_.append(text_ ? "Accept: text/plain" : "Accept: text/ttyml");
+
+  unsigned int columns = 0, lines = 0;
+  if (tty::window_size(STDOUT_FILENO, &columns, &lines)) {
+    if (columns > 0) headers_.append(string::cat("Tty-Columns: ", columns));
+    if (lines > 0) headers_.append(string::cat("Tty-Lines: ", lines));
+  }
+
+  if (session_.conditional_) {
+    const auto validators = session_.validators_.find(url_);
+    if (validators != session_.validators_.end()) {
+      if (!validators->second.etag_.empty())
+        headers_.append("If-None-Match: " + validators->second.etag_);
+      if (!validators->second.last_modified_.empty())
+        headers_.append("If-Modified-Since: " +
+                        validators->second.last_modified_);
+    }
   }
+
+  curl::setopt(curl_.get(), CURLOPT_HTTPHEADER, headers_.get());
+}
+
+void Context::begin_exchange() {
+  if (session_.recorder_ && !session_.player_) {
+    recording_ = std::make_unique<recording::exchange>();
+    recording_->method = request_method_;
+    recording_->url = url_;
+    recording_->body = body_;
+  }
+
+  start_ = std::chrono::steady_clock::now();
+}
+
+CURLcode Context::perform_transfer() {
+  // The entries of an earlier hop are not for this one.
+  curl::setopt(curl_.get(), CURLOPT_RESOLVE,
+               static_cast<curl_slist*>(nullptr));
+  resolve_.reset();
+
+  const auto remembered_address =
+      session_.host_cache_ &&
+      session_.host_cache_->prepare(curl_.get(), url_, &resolve_);
+
+  auto result = curl_easy_perform(curl_.get());
+
+  // A remembered address may be stale.  Nothing has been received when
+  // connecting fails, so it is safe to try again.
+  if (result == CURLE_COULDNT_CONNECT && remembered_address) {
+    session_.host_cache_->forget_address(url_, &resolve_);
+    curl::setopt(curl_.get(), CURLOPT_RESOLVE, resolve_.get());
+    start_ = std::chrono::steady_clock::now();
+    result = curl_easy_perform(curl_.get());
+  }
+
+  return result;
+}
+
+bool Context::redirecting() const {
+  switch (status_code_) {
+    case 301:
+    case 302:
+    case 303:
+    case 307:
+    case 308:
+      return !location_.empty();
+  }
+  return false;
+}
+
+bool Context::follow_redirect() {
+  if (!redirecting()) return false;
+
+  if (++redirects_ > kMaxRedirects)
+    throw std::runtime_error{string::cat("too many redirects, the last to '",
+                                         location_, "'")};
+
+  const auto location = url::resolve(location_, url_);
+
+  // Only GET requests may follow a cached 301, as other methods become GET.
+  if (status_code_ == 308 ||
+      (status_code_ == 301 && request_method_ == "GET")) {
+    auto& redirect = session_.permanent_redirects_[url_];
+    redirect.location_ = location;
+    redirect.keep_method_ = (status_code_ == 308);
+  }
+
+  // 307 and 308 repeat the request at the new location.  Like browsers, send
+  // a GET request for the others.
+  if (status_code_ != 307 && status_code_ != 308 && request_method_ != "GET") {
+    request_method_ = "GET";
+    body_.clear();
+    curl::setopt(curl_.get(), CURLOPT_CUSTOMREQUEST,
+                 static_cast<const char*>(nullptr));
+    curl::setopt(curl_.get(), CURLOPT_HTTPGET, 1L);
+  }
+  body_offset_ = 0;
+
+  url_ = location;
+  action_ = url_;
+  curl::setopt(curl_.get(), CURLOPT_URL, url_.c_str());
+
+  http_version_major_ = 1;
+  http_version_minor_ = 0;
+  status_code_ = 0;
+  status_message_.clear();
+  mime_type_.clear();
+  charset_ = "utf-8";
+  validators_ = Session::Validators{};
+  location_.clear();
+
+  set_headers();
+  begin_exchange();
+
+  return true;
+}
+
+void Context::end_document() {
+  if (text_) {
+    if (status_code_ >= 400)
+      throw std::runtime_error{string::cat(
+          "fetching ", url_, " failed: server responded with status ",
+          status_code_)};
+    return;
+  }
+
+  check_content_type();
+
+  {
+    ParserMemoryScope parser_memory{&parser_memory_};
+
+    if (fast_parser_ && !fast_parser_->parse(nullptr, 0, true))
+      switch_to_expat();
+
+    if (xml_parser_) {
+      XML_Parse(xml_parser_.get(), nullptr, 0, 1);
+      if (pending_exception_) std::rethrow_exception(pending_exception_);
+      check_parser_memory();
+    }
+  }
+
+  TRACE_WRITE_COUNTERS();
+
+  if (session_.conditional_ && status_code_ == 200)
+    session_.validators_[url_] = validators_;
+}
+
+void Context::check_content_type() const {
+  if (!mime_type_.empty() && mime_type_ != "text/ttyml")
+    throw std::runtime_error{string::cat(
+        "server responded with unsupported content type '", mime_type_, "'")};
 }
 
 std::unique_ptr<Context> Context::next_context() const {
+  TRACE_SPAN("Context::next_context");
+
   if (prompts_.empty()) return nullptr;
 
-  // Loop until we get a valid result.
-  for (;;) {
-    std::string data;
+  if (session_.output_) session_.output_->flush();
 
+  // Hidden variables can be large, so encode them only once, rather than on
+  // every attempt.
+  std::string encoded_vars;
+  if (!has_files()) {
     for (const auto& var : vars_)
-      url::append_key_value(&data, var.first, var.second);
+      url::append_key_value(&encoded_vars, var.first, var.second);
+  }
+
+  // Answers are only checked with the server on forms that ask for it.  A
+  // replayed session has no server to ask, and checks are not recorded, so
+  // answers are then left for the replayed submission to judge.
+  std::unique_ptr<Validation> validation;
+  if (!session_.player_ &&
+      std::any_of(prompts_.begin(), prompts_.end(), [](const Prompt& prompt) {
+        return !prompt.validate_url_.empty();
+      }))
+    validation = std::make_unique<Validation>(*this);
+
+  std::vector<size_t> all_prompts;
+  for (size_t i = 0; i < prompts_.size(); ++i) all_prompts.emplace_back(i);
+
+  // The prompts to ask for an answer.  After a rejection by the server,
+  // only those whose answers were rejected are asked again.
+  auto asking = all_prompts;
+  std::vector<std::string> answers(prompts_.size());
+
+  // Loop until we get a valid result.
+  for (;;) {
+    for (const auto index : asking) {
+      const auto& prompt = prompts_[index];
 
-    for (const auto& prompt : prompts_) {
       // Loop until we get valid input.
       for (;;) {
+        completing_prompt_s = &prompt;
+        completing_session_s = &session_;
+        rl_attempted_completion_function = complete;
+        rl_completer_word_break_characters =
+            prompt.has_completions() ? "" : nullptr;
+        if (!session_.working_directory_.empty()) {
+          rl_directory_rewrite_hook = resolve_completion_path;
+          rl_filename_stat_hook = resolve_completion_path;
+        }
+
+        // Report the checks of earlier answers as they complete.
+        if (validation && validation->validator_.pending()) {
+          validation_s = validation.get();
+          rl_event_hook = report_checks;
+        }
+
         std::unique_ptr<char[], decltype(&free)> value_buf{
             readline(prompt.prompt_.c_str()), free};
+        completing_prompt_s = nullptr;
+        completing_session_s = nullptr;
+        validation_s = nullptr;
+        rl_event_hook = nullptr;
+        rl_directory_rewrite_hook = nullptr;
+        rl_filename_stat_hook = nullptr;
         if (!value_buf) return nullptr;
 
         std::string value{value_buf.get()};
         string::strip(&value);
 
-        if (!std::regex_match(value, prompt.filter_regex_)) {
+        if (!prompt.filter_regex_str_.empty() &&
+            !std::regex_match(value, prompt.filter_regex_)) {
           if (!value.empty()) {
             if (!prompt.filter_message_.empty()) {
               std::cerr << prompt.filter_message_ << '\n';
@@ -159,42 +695,289 @@ std::unique_ptr<Context> Context::next_context() const {
           continue;
         }
 
-        url::append_key_value(&data, prompt.name_, value);
+        if (prompt.file_ && !session_.working_directory_.empty() &&
+            !value.empty() && value[0] != '/')
+          value = string::cat(session_.working_directory_, '/', value);
+
+        if (prompt.file_ && 0 != access(value.c_str(), R_OK)) {
+          std::cerr << "Cannot read '" << value << "': " << strerror(errno)
+                    << '\n';
+          continue;
+        }
+
+        answers[index] = std::move(value);
 
         break;
       }
+
+      if (validation && !prompt.validate_url_.empty()) {
+        validation->validator_.check(index, prompt.validate_url_,
+                                     prompt.name_, answers[index]);
+      }
     }
 
-    try {
-      auto url = url::normalize(action_, url_);
-
-      if (method_ != "POST" && !data.empty()) {
-        const auto q = url.find('?');
-        if (q != std::string::npos) url.erase(q);
-        url.push_back('?');
-        url.append(data);
-        data.clear();
+    if (validation) {
+      validation->report(validation->validator_.wait(), false);
+
+      if (!validation->rejected_.empty()) {
+        asking.swap(validation->rejected_);
+        validation->rejected_.clear();
+        std::sort(asking.begin(), asking.end());
+        continue;
       }
+    }
 
-      return std::make_unique<Context>(url.c_str(), method_.c_str(),
-                                       data.c_str());
+    try {
+      return submit(answers, encoded_vars, true);
     } catch (std::runtime_error& e) {
       std::cerr << "Error: " << e.what() << '\n';
+      asking = all_prompts;
       continue;
     }
   }
 }
 
+std::unique_ptr<Context> Context::prepare_submit(
+    const std::unordered_map<std::string, std::string>& answers) const {
+  std::vector<std::string> values;
+  for (const auto& prompt : prompts_) {
+    const auto answer = answers.find(prompt.name_);
+    values.emplace_back(answer != answers.end() ? answer->second
+                                                : std::string{});
+  }
+
+  std::string encoded_vars;
+  if (!has_files()) {
+    for (const auto& var : vars_)
+      url::append_key_value(&encoded_vars, var.first, var.second);
+  }
+
+  return submit(values, encoded_vars, false);
+}
+
+bool Context::has_files() const {
+  return std::any_of(prompts_.begin(), prompts_.end(),
+                     [](const Prompt& prompt) { return prompt.file_; });
+}
+
+std::unique_ptr<Context> Context::submit(
+    const std::vector<std::string>& answers, const std::string& encoded_vars,
+    bool perform) const {
+  auto url = url::normalize(action_, url_);
+
+  // Files can only be sent as multipart/form-data.
+  if (has_files()) {
+    std::vector<FormField> fields;
+
+    for (const auto& var : vars_) {
+      fields.emplace_back();
+      fields.back().name_ = var.first;
+      fields.back().value_ = var.second;
+    }
+
+    for (size_t i = 0; i < prompts_.size(); ++i) {
+      fields.emplace_back();
+      fields.back().name_ = prompts_[i].name_;
+      fields.back().value_ = answers[i];
+      fields.back().file_ = prompts_[i].file_;
+      fields.back().gzip_ = prompts_[i].gzip_;
+    }
+
+    return std::unique_ptr<Context>{
+        new Context{session_, url.c_str(), "POST", std::string{},
+                    std::move(fields), perform}};
+  }
+
+  auto data = encoded_vars;
+
+  for (size_t i = 0; i < prompts_.size(); ++i)
+    url::append_key_value(&data, prompts_[i].name_, answers[i]);
+
+  if (method_ != "POST" && !data.empty()) {
+    const auto q = url.find('?');
+    if (q != std::string::npos) url.erase(q);
+    url.push_back('?');
+    url.append(data);
+    data.clear();
+  }
+
+  return std::unique_ptr<Context>{
+      new Context{session_, url.c_str(), method_.c_str(), std::move(data),
+                  std::vector<FormField>{}, perform}};
+}
+
+void Context::set_body(const char* method, std::string&& body,
+                       const std::vector<FormField>& fields) {
+  if (!fields.empty()) {
+    mime_.reset(curl_mime_init(curl_.get()));
+    if (!mime_) throw std::runtime_error{"curl_mime_init failed"};
+
+    for (const auto& field : fields) {
+      const auto part = curl_mime_addpart(mime_.get());
+      if (!part) throw std::runtime_error{"curl_mime_addpart failed"};
+
+      curl::check(curl_mime_name(part, field.name_.c_str()), "curl_mime_name");
+
+      if (!field.file_) {
+        curl::check(
+            curl_mime_data(part, field.value_.data(), field.value_.size()),
+            "curl_mime_data");
+        continue;
+      }
+
+      uploads_.emplace_back(
+          std::make_unique<upload::file_reader>(field.value_, field.gzip_));
+
+      curl::check(
+          curl_mime_data_cb(
+              part, uploads_.back()->size(),
+              +[](char* buffer, size_t size, size_t nitems,
+                  void* arg) -> size_t {
+                try {
+                  return static_cast<upload::file_reader*>(arg)->read(
+                      buffer, size * nitems);
+                } catch (std::runtime_error&) {
+                  return CURL_READFUNC_ABORT;
+                }
+              },
+              +[](void* arg, curl_off_t offset, int origin) -> int {
+                if (offset != 0 || origin != SEEK_SET)
+                  return CURL_SEEKFUNC_CANTSEEK;
+                static_cast<upload::file_reader*>(arg)->rewind();
+                return CURL_SEEKFUNC_OK;
+              },
+              nullptr, uploads_.back().get()),
+          "curl_mime_data_cb");
+
+      const auto slash = field.value_.rfind('/');
+      curl::check(curl_mime_filename(
+                      part, (slash == std::string::npos)
+                                ? field.value_.c_str()
+                                : field.value_.c_str() + slash + 1),
+                  "curl_mime_filename");
+      curl::check(curl_mime_type(part, "application/octet-stream"),
+                  "curl_mime_type");
+
+      if (field.gzip_) {
+        curl::string_list part_headers;
+        part_headers.append("Content-Encoding: gzip");
+        curl::check(curl_mime_headers(part, part_headers.get(), 1),
+                    "curl_mime_headers");
+        part_headers.release();
+      }
+    }
+
+    curl::setopt(curl_.get(), CURLOPT_MIMEPOST, mime_.get());
+  } else if (0 == std::strcmp(method, "POST")) {
+    body_ = std::move(body);
+
+    curl::setopt(curl_.get(), CURLOPT_POST, 1L);
+    curl::setopt(curl_.get(), CURLOPT_POSTFIELDSIZE_LARGE,
+                 static_cast<curl_off_t>(body_.size()));
+    curl::setopt(curl_.get(), CURLOPT_READDATA, this);
+    curl::setopt(curl_.get(), CURLOPT_READFUNCTION,
+                 +[](char* buffer, size_t size, size_t nitems,
+                     void* void_context) -> size_t {
+                   const auto context = static_cast<Context*>(void_context);
+                   const auto amount =
+                       std::min(size * nitems,
+                                context->body_.size() - context->body_offset_);
+                   std::memcpy(buffer,
+                               context->body_.data() + context->body_offset_,
+                               amount);
+                   context->body_offset_ += amount;
+                   return amount;
+                 });
+    curl::setopt(curl_.get(), CURLOPT_SEEKDATA, this);
+    curl::setopt(curl_.get(), CURLOPT_SEEKFUNCTION,
+                 +[](void* void_context, curl_off_t offset, int origin) -> int {
+                   const auto context = static_cast<Context*>(void_context);
+                   if (origin != SEEK_SET || offset < 0 ||
+                       static_cast<size_t>(offset) > context->body_.size())
+                     return CURL_SEEKFUNC_CANTSEEK;
+                   context->body_offset_ = offset;
+                   return CURL_SEEKFUNC_OK;
+                 });
+  } else if (0 != std::strcmp(method, "GET")) {
+    curl::setopt(curl_.get(), CURLOPT_CUSTOMREQUEST, method);
+  }
+}
+
+std::uint64_t Context::microseconds_since_start() const {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start_)
+      .count();
+}
+
+void Context::record(bool header, const void* buf, size_t size) {
+  if (!recording_) return;
+
+  recording::chunk c;
+  c.header = header;
+  c.offset_us = microseconds_since_start();
+  c.data.assign(static_cast<const char*>(buf), size);
+  recording_->chunks.emplace_back(std::move(c));
+}
+
+void Context::replay(const recording::exchange& e) {
+  start_ = std::chrono::steady_clock::now();
+
+  for (const auto& c : e.chunks) {
+    if (session_.replay_delays_)
+      std::this_thread::sleep_until(start_ +
+                                    std::chrono::microseconds(c.offset_us));
+
+    if (c.header)
+      put_header(c.data.data(), c.data.size());
+    else
+      put(c.data.data(), c.data.size());
+
+    if (pending_exception_) std::rethrow_exception(pending_exception_);
+  }
+
+  if (session_.replay_delays_)
+    std::this_thread::sleep_until(start_ +
+                                  std::chrono::microseconds(e.duration_us));
+}
+
+std::unique_ptr<tty::Writer> Context::make_line_writer() const {
+  if (session_.screen_)
+    return std::make_unique<tty::ScreenWriter>(*session_.screen_);
+  if (session_.document_)
+    return std::make_unique<tty::DocumentWriter>(*session_.document_);
+
+  switch (session_.output_format_) {
+    case Session::OutputFormat::Plain:
+      return std::make_unique<tty::PlainWriter>(*session_.output_);
+    case Session::OutputFormat::Jsonl:
+      return std::make_unique<tty::JsonLineWriter>(*session_.output_);
+    case Session::OutputFormat::Terminal:
+      break;
+  }
+
+  return std::make_unique<tty::StdoutWriter>();
+}
+
+void Context::put_event(std::string event) const {
+  event.push_back('\n');
+  session_.output_->append(event);
+}
+
 void Context::put_header(const void* buf, size_t size) {
   std::string line{static_cast<const char*>(buf), size};
   string::strip_right(&line);
   if (line.empty()) return;
 
-  if (status_message_.empty()) {
+  // Interim 1xx responses are followed by another status line.
+  if (string::starts_with(line, "HTTP/")) {
     int status_offset = 0;
 
+    // HTTP/2 and later have no minor version.
+    http_version_minor_ = 0;
     if (3 != sscanf(line.c_str(), "HTTP/%u.%u %u %n", &http_version_major_,
-                    &http_version_minor_, &status_code_, &status_offset)) {
+                    &http_version_minor_, &status_code_, &status_offset) &&
+        2 != sscanf(line.c_str(), "HTTP/%u %u %n", &http_version_major_,
+                    &status_code_, &status_offset)) {
       throw std::runtime_error{
           string::cat("invalid status header: '", line, "'")};
     }
@@ -204,6 +987,10 @@ void Context::put_header(const void* buf, size_t size) {
     return;
   }
 
+  if (!status_code_)
+    throw std::runtime_error{
+        string::cat("invalid status header: '", line, "'")};
+
   std::string::size_type i;
   std::string key;
 
@@ -231,49 +1018,131 @@ void Context::put_header(const void* buf, size_t size) {
       if (string::starts_with(data[i], "charset="))
         charset_ = data[i].substr(8);
     }
-
-    if (mime_type_ != "text/ttyml") {
-      throw std::runtime_error{
-          string::cat("server responded with unsupported content type '",
-                      line.substr(i), "'")};
-    }
+  } else if (key == "etag") {
+    validators_.etag_ = line.substr(i);
+  } else if (key == "last-modified") {
+    validators_.last_modified_ = line.substr(i);
+  } else if (key == "location") {
+    location_ = line.substr(i);
   }
 }
 
 void Context::put(const void* buf, size_t size) {
-  if (!xml_parser_) {
-    xml_parser_.reset(XML_ParserCreateNS(charset_.c_str(), '|'));
-    if (!xml_parser_)
-      throw std::runtime_error{"XML_ParserCreate returned NULL"};
+  // The body of a redirect is not shown.
+  if (redirecting()) return;
+
+  TRACE_SPAN("Context::put");
+  TRACE_COUNT("bytes", size);
+
+  document_bytes_ += size;
+  if (document_bytes_ > session_.limits_.document_bytes_)
+    throw std::runtime_error{string::cat("page is larger than the limit of ",
+                                         session_.limits_.document_bytes_,
+                                         " bytes")};
+
+  if (text_) {
+    text_->append(static_cast<const char*>(buf), size);
+    return;
+  }
+
+  ParserMemoryScope parser_memory{&parser_memory_};
+
+  if (!fast_parser_ && !xml_parser_) {
+    check_content_type();
 
-    CHECK_EXPAT(XML_SetBase(xml_parser_.get(), url_.c_str()));
+    if (session_.fast_xml_ && charset_ == "utf-8")
+      fast_parser_ = std::make_unique<xml::fast_parser>(
+          this, on_start_element, on_end_element, on_character_data, '|');
+    else
+      switch_to_expat();
+  }
+
+  if (xml_parser_) {
+    CHECK_EXPAT(
+        XML_Parse(xml_parser_.get(), static_cast<const char*>(buf), size, 0));
+  } else if (!fast_parser_->parse(static_cast<const char*>(buf), size,
+                                  false)) {
+    switch_to_expat();
+  }
+
+  // Pass on what arrived right away, for consumers following a slow page.
+  if (session_.output_) session_.output_->flush();
 
-    XML_SetUserData(xml_parser_.get(), this);
+  TRACE_WRITE_COUNTERS();
+}
 
-    XML_SetElementHandler(
-        xml_parser_.get(),
-        +[](void* user_data, const XML_Char* name, const XML_Char** atts) {
-          const auto context = static_cast<Context*>(user_data);
-          context->wrap_exception([=] { context->start_element(name, atts); });
-        },
-        +[](void* user_data, const XML_Char* name) {
-          const auto context = static_cast<Context*>(user_data);
-          context->wrap_exception([=] { context->end_element(name); });
-        });
+void Context::switch_to_expat() {
+  static const XML_Memory_Handling_Suite memory_suite{
+      parser_malloc, parser_realloc, parser_free};
 
-    XML_SetCharacterDataHandler(
-        xml_parser_.get(), +[](void* user_data, const XML_Char* s, int len) {
-          const auto context = static_cast<Context*>(user_data);
-          context->wrap_exception([=] { context->character_data(s, len); });
-        });
+  parser_memory_.limit_ = session_.limits_.parser_memory_;
+  xml_parser_.reset(
+      XML_ParserCreate_MM(charset_.c_str(), &memory_suite, "|"));
+  if (!xml_parser_) throw std::runtime_error{"XML_ParserCreate returned NULL"};
+
+  CHECK_EXPAT(XML_SetBase(xml_parser_.get(), url_.c_str()));
+
+  XML_SetUserData(xml_parser_.get(), this);
+
+  if (fast_parser_) {
+    // Bring Expat to where the fast parser stopped before setting the
+    // handlers, so that nothing is reported twice.
+    const auto prefix = fast_parser_->prefix();
+    CHECK_EXPAT(XML_Parse(xml_parser_.get(), prefix.data(), prefix.size(), 0));
   }
 
-  CHECK_EXPAT(
-      XML_Parse(xml_parser_.get(), static_cast<const char*>(buf), size, 0));
+  XML_SetElementHandler(xml_parser_.get(), on_start_element, on_end_element);
+  XML_SetCharacterDataHandler(xml_parser_.get(), on_character_data);
+
+  if (fast_parser_) {
+    const auto fast_parser = std::move(fast_parser_);
+    const auto& rest = fast_parser->rest();
+    CHECK_EXPAT(XML_Parse(xml_parser_.get(), rest.data(), rest.size(), 0));
+  }
+}
+
+void Context::check_parser_memory() const {
+  if (parser_memory_.exceeded_)
+    throw std::runtime_error{string::cat(
+        "page needs more than the limit of ", parser_memory_.limit_,
+        " bytes of parser memory")};
+}
+
+void Context::on_start_element(void* user_data, const XML_Char* name,
+                               const XML_Char** atts) {
+  const auto context = static_cast<Context*>(user_data);
+  if (!context->wrap_exception([=] { context->start_element(name, atts); }))
+    context->stop_parser();
+}
+
+void Context::on_end_element(void* user_data, const XML_Char* name) {
+  const auto context = static_cast<Context*>(user_data);
+  if (!context->wrap_exception([=] { context->end_element(name); }))
+    context->stop_parser();
+}
+
+void Context::on_character_data(void* user_data, const XML_Char* s, int len) {
+  const auto context = static_cast<Context*>(user_data);
+  if (!context->wrap_exception([=] { context->character_data(s, len); }))
+    context->stop_parser();
+}
+
+void Context::stop_parser() {
+  if (xml_parser_) XML_StopParser(xml_parser_.get(), XML_FALSE);
 }
 
 void Context::start_element(const XML_Char* name, const XML_Char** atts) {
-  const auto element_it = tag_to_element_s.find(name);
+  TRACE_SPAN("Context::start_element");
+  TRACE_COUNT("elements", 1);
+
+  const auto& limits = session_.limits_;
+
+  if (stack_.size() >= limits.depth_)
+    throw std::runtime_error{string::cat(
+        "page nests elements deeper than the limit of ", limits.depth_)};
+
+  element_name_.assign(name);
+  const auto element_it = tag_to_element_s.find(element_name_);
   auto out_element = Element::Unknown;
   if (element_it != tag_to_element_s.end()) {
     switch (element_it->second) {
@@ -290,13 +1159,25 @@ void Context::start_element(const XML_Char* name, const XML_Char** atts) {
             else if (0 == std::strcmp(attr_name, "method"))
               method_.assign(attr_value);
           }
+
+          string::ascii_toupper(&method_);
+
+          if (session_.output_format_ == Session::OutputFormat::Jsonl) {
+            std::string event;
+            json::object_writer writer{&event};
+            writer.add("type", "form");
+            writer.add("action", url::normalize(action_, url_));
+            writer.add("method", method_);
+            writer.close();
+            put_event(event);
+          }
         }
         break;
 
       case Element::Line:
         if (!stack_.empty() && stack_.back() == Element::Root) {
           out_element = Element::Line;
-          writer_stack_.emplace_back(std::make_unique<tty::StdoutWriter>());
+          writer_stack_.emplace_back(make_line_writer());
         }
         break;
 
@@ -307,6 +1188,10 @@ void Context::start_element(const XML_Char* name, const XML_Char** atts) {
           const char* name = nullptr;
           const char* filter_regex = nullptr;
           const char* filter_message = nullptr;
+          const char* options_url = nullptr;
+          const char* validate_url = nullptr;
+          const char* type = nullptr;
+          const char* encoding = nullptr;
 
           for (size_t attr_idx = 0; atts[attr_idx]; attr_idx += 2) {
             const auto attr_name = atts[attr_idx];
@@ -318,6 +1203,14 @@ void Context::start_element(const XML_Char* name, const XML_Char** atts) {
               filter_message = attr_value;
             else if (0 == std::strcmp(attr_name, "name"))
               name = attr_value;
+            else if (0 == std::strcmp(attr_name, "options-url"))
+              options_url = attr_value;
+            else if (0 == std::strcmp(attr_name, "validate-url"))
+              validate_url = attr_value;
+            else if (0 == std::strcmp(attr_name, "type"))
+              type = attr_value;
+            else if (0 == std::strcmp(attr_name, "encoding"))
+              encoding = attr_value;
           }
 
           if (!name) {
@@ -325,19 +1218,78 @@ void Context::start_element(const XML_Char* name, const XML_Char** atts) {
                 "prompt element is missing name attribute"};
           }
 
+          if (prompts_.size() >= limits.prompts_)
+            throw std::runtime_error{string::cat(
+                "page has more prompts than the limit of ", limits.prompts_)};
+
           prompts_.emplace_back(name);
 
           auto& prompt = prompts_.back();
 
           if (filter_regex) {
+            if (regex_size(filter_regex, limits.regex_size_) >
+                limits.regex_size_)
+              throw std::runtime_error{
+                  string::cat("filter-regex '", filter_regex,
+                              "' is larger than the limit of ",
+                              limits.regex_size_)};
+
             prompt.filter_regex_str_.assign(filter_regex);
             prompt.filter_regex_.assign(prompt.filter_regex_str_);
           }
 
           if (filter_message) prompt.filter_message_.assign(filter_message);
 
-          writer_stack_.emplace_back(
-              std::make_unique<tty::PromptWriter>(prompt.prompt_));
+          if (options_url)
+            prompt.options_url_ = url::normalize(options_url, url_);
+
+          if (type && 0 == std::strcmp(type, "file")) {
+            prompt.file_ = true;
+          } else if (type && 0 != std::strcmp(type, "text")) {
+            throw std::runtime_error{
+                string::cat("invalid prompt type '", type, "'")};
+          }
+
+          // The server cannot check a file by its path.
+          if (validate_url) {
+            if (prompt.file_)
+              throw std::runtime_error{
+                  "validate-url is not supported for file prompts"};
+            prompt.validate_url_ = url::normalize(validate_url, url_);
+          }
+
+          if (encoding && 0 == std::strcmp(encoding, "gzip")) {
+            prompt.gzip_ = true;
+          } else if (encoding && 0 != std::strcmp(encoding, "identity")) {
+            throw std::runtime_error{
+                string::cat("invalid prompt encoding '", encoding, "'")};
+          }
+
+          writer_stack_.emplace_back(std::make_unique<tty::PromptWriter>(
+              prompt.prompt_,
+              session_.output_format_ == Session::OutputFormat::Terminal));
+        }
+        break;
+
+      case Element::Option:
+        if (!stack_.empty() && stack_.back() == Element::Prompt) {
+          out_element = Element::Option;
+
+          const char* value = nullptr;
+
+          for (size_t attr_idx = 0; atts[attr_idx]; attr_idx += 2) {
+            if (0 == std::strcmp(atts[attr_idx], "value"))
+              value = atts[attr_idx + 1];
+          }
+
+          if (!value) {
+            throw std::runtime_error{
+                "option element is missing value attribute"};
+          }
+
+          auto& options = prompts_.back().options_;
+          options.append(value);
+          options.push_back('\n');
         }
         break;
 
@@ -345,6 +1297,67 @@ void Context::start_element(const XML_Char* name, const XML_Char** atts) {
         if (stack_.empty()) out_element = Element::Root;
         break;
 
+      case Element::Table:
+        if (!stack_.empty() && stack_.back() == Element::Root) {
+          out_element = Element::Table;
+
+          std::vector<unsigned int> widths;
+          size_t window = 100;
+
+          for (size_t attr_idx = 0; atts[attr_idx]; attr_idx += 2) {
+            const auto attr_name = atts[attr_idx];
+            const auto attr_value = atts[attr_idx + 1];
+
+            if (0 == std::strcmp(attr_name, "widths")) {
+              for (const auto& width :
+                   string::split<std::vector<std::string>>(attr_value, ',')) {
+                if (width == "*") {
+                  widths.emplace_back(0);
+                  continue;
+                }
+
+                char* endptr = nullptr;
+                const auto value = std::strtoul(width.c_str(), &endptr, 10);
+                if (width.empty() || *endptr || !value || value > 1000) {
+                  throw std::runtime_error{
+                      string::cat("invalid widths attribute '", attr_value,
+                                  "'")};
+                }
+                widths.emplace_back(value);
+              }
+            } else if (0 == std::strcmp(attr_name, "window")) {
+              char* endptr = nullptr;
+              window = std::strtoul(attr_value, &endptr, 10);
+              if (!*attr_value || *endptr || !window || window > 10000) {
+                throw std::runtime_error{
+                    string::cat("invalid window attribute '", attr_value,
+                                "'")};
+              }
+            }
+          }
+
+          table_ = std::make_unique<tty::Table>(
+              [this] { return make_line_writer(); }, std::move(widths),
+              window);
+        }
+        break;
+
+      case Element::Row:
+        if (!stack_.empty() && stack_.back() == Element::Table) {
+          out_element = Element::Row;
+          row_.clear();
+        }
+        break;
+
+      case Element::Cell:
+        if (!stack_.empty() && stack_.back() == Element::Row) {
+          out_element = Element::Cell;
+          row_.emplace_back();
+          writer_stack_.emplace_back(
+              std::make_unique<tty::CellWriter>(row_.back()));
+        }
+        break;
+
       case Element::Style:
         if (!writer_stack_.empty()) {
           auto& writer = *writer_stack_.back();
@@ -373,7 +1386,7 @@ void Context::start_element(const XML_Char* name, const XML_Char** atts) {
             }
           }
 
-          writer.transition(writer.style_stack_.back(), new_style);
+          writer.set_style(new_style);
           writer.style_stack_.emplace_back(new_style);
         }
         break;
@@ -397,7 +1410,27 @@ void Context::start_element(const XML_Char* name, const XML_Char** atts) {
         if (!value)
           throw std::runtime_error{"var element is missing value attribute"};
 
+        if (vars_.size() >= limits.vars_)
+          throw std::runtime_error{string::cat(
+              "page has more vars than the limit of ", limits.vars_)};
+
+        var_bytes_ += std::strlen(name) + std::strlen(value);
+        if (var_bytes_ > limits.var_bytes_)
+          throw std::runtime_error{string::cat(
+              "page has more var data than the limit of ", limits.var_bytes_,
+              " bytes")};
+
         vars_.emplace_back(name, value);
+
+        if (session_.output_format_ == Session::OutputFormat::Jsonl) {
+          std::string event;
+          json::object_writer writer{&event};
+          writer.add("type", "var");
+          writer.add("name", name);
+          writer.add("value", value);
+          writer.close();
+          put_event(event);
+        }
       } break;
 
       case Element::Unknown:
@@ -409,27 +1442,69 @@ void Context::start_element(const XML_Char* name, const XML_Char** atts) {
 }
 
 void Context::end_element(const XML_Char* name) {
+  TRACE_SPAN("Context::end_element");
+
   if (stack_.empty()) throw std::logic_error{"unexpected end element call"};
   switch (stack_.back()) {
-    case Element::Line:
+    case Element::Line: {
+      TRACE_SPAN("Writer::end_line");
+      TRACE_COUNT("lines", 1);
+      auto& writer = *writer_stack_.back();
+      apply_style(&writer);
+      writer.end_line();
       writer_stack_.pop_back();
-      std::cout << std::endl;
-      if (std::cout.bad())
-        throw std::runtime_error{"write to standard output failed"};
-      break;
+    } break;
 
     case Element::Style: {
       auto& writer = *writer_stack_.back();
-      writer.transition(writer.style_stack_.back(),
-                        writer.style_stack_[writer.style_stack_.size() - 2]);
       writer.style_stack_.pop_back();
+      writer.set_style(writer.style_stack_.back());
     } break;
 
     case Element::Prompt:
+      apply_style(writer_stack_.back().get());
+      writer_stack_.pop_back();
+
+      if (session_.output_format_ == Session::OutputFormat::Jsonl) {
+        const auto& prompt = prompts_.back();
+
+        std::string event;
+        json::object_writer writer{&event};
+        writer.add("type", "prompt");
+        writer.add("name", prompt.name_);
+        writer.add("text", prompt.prompt_);
+        if (prompt.file_) writer.add("file", true);
+        if (!prompt.options_.empty()) {
+          auto options = string::split<std::vector<std::string>>(
+              prompt.options_, '\n');
+          options.pop_back();
+          writer.add("options", options);
+        }
+        if (!prompt.options_url_.empty())
+          writer.add("options_url", prompt.options_url_);
+        if (!prompt.validate_url_.empty())
+          writer.add("validate_url", prompt.validate_url_);
+        writer.close();
+        put_event(event);
+      }
+      break;
+
+    case Element::Cell:
       writer_stack_.pop_back();
       break;
 
+    case Element::Row:
+      table_->add_row(std::move(row_));
+      row_.clear();
+      break;
+
+    case Element::Table:
+      table_->finish();
+      table_.reset();
+      break;
+
     case Element::Form:
+    case Element::Option:
     case Element::Root:
     case Element::Var:
     case Element::Unknown:
@@ -439,17 +1514,33 @@ void Context::end_element(const XML_Char* name) {
 }
 
 void Context::character_data(const XML_Char* s, int len) {
+  TRACE_SPAN("Context::character_data");
+
+  // Entity references can expand to much more than the document itself.
+  text_bytes_ += len;
+  if (text_bytes_ > session_.limits_.document_bytes_)
+    throw std::runtime_error{
+        string::cat("page text is longer than the limit of ",
+                    session_.limits_.document_bytes_, " bytes")};
+
   if (stack_.empty()) return;
 
   switch (stack_.back()) {
+    case Element::Cell:
     case Element::Line:
     case Element::Prompt:
-    case Element::Style:
-      writer_stack_.back()->put(s, len);
-      break;
+    case Element::Style: {
+      const auto writer = writer_stack_.back().get();
+      apply_style(writer);
+      TRACE_SPAN("Writer::put");
+      writer->write(s, len);
+    } break;
 
     case Element::Form:
+    case Element::Option:
     case Element::Root:
+    case Element::Row:
+    case Element::Table:
     case Element::Var:
     case Element::Unknown:
       break;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <exception>
 #include <memory>
 #include <regex>
@@ -9,26 +11,192 @@
 #include <curl/curl.h>
 #include <expat.h>
 
+#include "util/completion.h"
+#include "util/curl.h"
+#include "util/document.h"
+#include "util/recording.h"
+#include "util/screen.h"
+#include "util/table.h"
 #include "util/tty.h"
+#include "util/upload.h"
+#include "util/xml.h"
 
 namespace ttyml {
 
+class HostCache;
+
+// A field of a form submitted as multipart/form-data.
+struct FormField {
+  std::string name_;
+
+  // The value of the field, or the path of the file to upload if `file_` is
+  // set.
+  std::string value_;
+
+  bool file_ = false;
+
+  // If true, the file is sent gzip compressed, with Content-Encoding: gzip.
+  bool gzip_ = false;
+};
+
+// State shared by every page loaded during one invocation.
+struct Session {
+  // Cache validators from the most recent response for a URL.
+  struct Validators {
+    std::string etag_;
+    std::string last_modified_;
+  };
+
+  // If set, all transfers share DNS cache, TLS sessions and connections
+  // through this handle.
+  CURLSH* share_ = nullptr;
+
+  // If set, resolved addresses and TLS sessions are remembered across
+  // invocations.
+  HostCache* host_cache_ = nullptr;
+
+  // If not empty, server certificates are verified against this file instead
+  // of the default certificate authorities.
+  std::string ca_file_;
+
+  // If not empty, relative paths given as answers to file prompts are taken
+  // relative to this directory instead of the current one.
+  std::string working_directory_;
+
+  // If set, lines are rendered into this screen instead of standard output.
+  tty::Screen* screen_ = nullptr;
+
+  // If set, and `screen_` is not, lines are collected in this document
+  // instead of being written to standard output.
+  tty::Document* document_ = nullptr;
+
+  // If true, requests carry the validators of the previous response for the
+  // same URL, so that the server can answer 304 Not Modified.
+  bool conditional_ = false;
+
+  std::unordered_map<std::string, Validators> validators_;
+
+  // Where a page that has moved permanently, with status 301 or 308, is now.
+  struct PermanentRedirect {
+    std::string location_;
+
+    // True for 308, which applies to every method.  301 applies only to GET.
+    bool keep_method_ = false;
+  };
+
+  // Requests for these URLs go straight to the new location.
+  std::unordered_map<std::string, PermanentRedirect> permanent_redirects_;
+
+  // How lines are written when neither `screen_` nor `document_` is set.
+  enum class OutputFormat {
+    // Styled text for a terminal.
+    Terminal,
+
+    // Unstyled text.
+    Plain,
+
+    // One JSON object per line for each line, form, variable and prompt.
+    Jsonl,
+  };
+
+  OutputFormat output_format_ = OutputFormat::Terminal;
+
+  // Where output is collected in the plain and JSONL formats.
+  tty::OutputBuffer* output_ = nullptr;
+
+  // If set, every completed exchange with a server is written to this
+  // recording.
+  recording::writer* recorder_ = nullptr;
+
+  // If set, responses are taken from this recording instead of the network.
+  recording::player* player_ = nullptr;
+
+  // If true, recorded responses are replayed with their original timing.
+  // Otherwise they are replayed as fast as possible.
+  bool replay_delays_ = true;
+
+  // If true, UTF-8 documents are parsed with xml::fast_parser for as long as
+  // they stay within what it supports, and with Expat from there on.
+  bool fast_xml_ = true;
+
+  // Bounds on what one page may make the client hold, so that a broken or
+  // hostile server cannot exhaust memory.  A page exceeding one fails with
+  // an error.
+  struct Limits {
+    // Bytes of the response body, and separately, of the text it expands to
+    // after entity references.
+    std::uint64_t document_bytes_ = UINT64_C(1) << 30;
+
+    // Depth of nested elements.
+    size_t depth_ = 256;
+
+    // Number of var elements, and the total size of their names and values.
+    size_t vars_ = 10000;
+    size_t var_bytes_ = 64 << 20;
+
+    size_t prompts_ = 1000;
+
+    // Size of a filter-regex, counting counted repetitions as copies of what
+    // they repeat.
+    size_t regex_size_ = 10000;
+
+    // Memory allocated by Expat.
+    size_t parser_memory_ = 64 << 20;
+  };
+
+  Limits limits_;
+};
+
 class Context {
  public:
-  Context(const char* url, const char* method = "GET",
+  Context(Session& session, const char* url, const char* method = "GET",
           const char* data = nullptr);
 
+  // Submits `fields` to `url` as multipart/form-data.
+  Context(Session& session, const char* url, std::vector<FormField> fields);
+
+  // Prepares a request without performing it, so that the caller can drive
+  // the transfer of `handle()` with a curl multi handle, and then call
+  // `finish`.  The session's host cache and recording player are not used.
+  static std::unique_ptr<Context> prepare(Session& session, const char* url,
+                                          const char* method = "GET",
+                                          const char* data = nullptr);
+
+  CURL* handle() const { return curl_.get(); }
+
+  // Completes a prepared request whose transfer ended with `result`.  Throws
+  // if the transfer or the page failed.  Returns false if the response was a
+  // redirect, in which case `handle()` is ready to be performed again for
+  // the new location.
+  bool finish(CURLcode result);
+
   bool has_prompt() const { return !prompts_.empty(); }
 
+  unsigned int status_code() const { return status_code_; }
+
+  // Returns true if the server reported that the page is unchanged since the
+  // previous conditional request, in which case nothing was rendered.
+  bool not_modified() const { return status_code_ == 304; }
+
   std::unique_ptr<Context> next_context() const;
 
+  // Prepares the submission of the form, like `prepare`, with answers given
+  // by prompt name.  Prompts without an answer are submitted empty, and
+  // answers are not checked against the prompts' filters.
+  std::unique_ptr<Context> prepare_submit(
+      const std::unordered_map<std::string, std::string>& answers) const;
+
  private:
   enum class Element {
+    Cell,
     Form,
     Line,
+    Option,
     Prompt,
     Root,
+    Row,
     Style,
+    Table,
     Var,
 
     Unknown,
@@ -44,16 +212,96 @@ class Context {
     std::regex filter_regex_;
 
     std::string filter_message_;
+
+    // If true, the answer is the path of a file to upload.
+    bool file_ = false;
+    bool gzip_ = false;
+
+    // Newline separated completion candidates from option elements.
+    std::string options_;
+    std::string options_url_;
+
+    // If not empty, answers are checked with this endpoint as they are
+    // given, as described for Validator.
+    std::string validate_url_;
+
+    bool has_completions() const {
+      return !options_.empty() || !options_url_.empty();
+    }
+
+    // Returns the completion candidates, building the index on first use.
+    // Candidates from `options_url_` are fetched with `fetch_text`.
+    const completion::sorted_list& completions(Session& session) const;
+
+   private:
+    mutable std::unique_ptr<completion::sorted_list> completions_;
   };
 
   static const std::unordered_map<std::string, Element> tag_to_element_s;
 
+  // The prompt currently being answered, and the session fetching its
+  // completions, for the readline completion callbacks.
+  static const Prompt* completing_prompt_s;
+  static Session* completing_session_s;
+
+  static char* complete_option(const char* text, int state);
+  static char** complete(const char* text, int start, int end);
+
+  // Makes file name completion look up relative paths in the completing
+  // session's working directory.
+  static int resolve_completion_path(char** path);
+
+  // Answers being checked with the server while the user answers other
+  // prompts, for the readline event hook.
+  struct Validation;
+  static Validation* validation_s;
+
+  // Reports the checks that have completed while readline waits for input.
+  static int report_checks();
+
+  // Fetches the text at `url` like a page, following redirects and using
+  // the session's connections, host cache and recording, but returns the
+  // body instead of rendering it.  Throws if the server responds with an
+  // error status, or with more than the session's limit for a document.
+  static std::string fetch_text(Session& session, const std::string& url);
+
+  // The most redirects followed for one request.
+  static const unsigned int kMaxRedirects = 10;
+
+  Session& session_;
+
+  // If set, the response body is collected here by `fetch_text` instead of
+  // being parsed as a page.
+  std::string* text_ = nullptr;
+
+  // The URL requested, which becomes the location of any redirect.
   std::string url_;
+  std::string request_method_;
+  unsigned int redirects_ = 0;
 
   std::unique_ptr<CURL, decltype(&curl_easy_cleanup)> curl_;
 
+  // Request headers, which must outlive the transfer.
+  curl::string_list headers_;
+
+  // Host cache entries for CURLOPT_RESOLVE, which must outlive the transfer
+  // too.
+  curl::string_list resolve_;
+
+  // The body of a POST request, and how much of it curl has read.
+  std::string body_;
+  size_t body_offset_ = 0;
+
+  std::vector<std::unique_ptr<upload::file_reader>> uploads_;
+  std::unique_ptr<curl_mime, decltype(&curl_mime_free)> mime_;
+
   std::exception_ptr pending_exception_;
 
+  // When the transfer started, and what has been received so far if the
+  // session is being recorded.
+  std::chrono::steady_clock::time_point start_;
+  std::unique_ptr<recording::exchange> recording_;
+
   unsigned int http_version_major_ = 1;
   unsigned int http_version_minor_ = 0;
   unsigned int status_code_ = 0;
@@ -61,20 +309,121 @@ class Context {
 
   std::string mime_type_;
   std::string charset_ = "utf-8";
+  std::string location_;
+
+  Session::Validators validators_;
+
+  // Memory allocated by Expat for this page.  Expat's allocation functions
+  // take no user data, so allocations are charged to the page whose
+  // ParserMemoryScope is innermost on the calling thread.
+  struct ParserMemory {
+    size_t used_ = 0;
+    size_t limit_ = 0;
+    bool exceeded_ = false;
+  };
+
+  class ParserMemoryScope;
+
+  static thread_local ParserMemory* parser_memory_s;
+
+  static void* parser_malloc(size_t size);
+  static void* parser_realloc(void* ptr, size_t size);
+  static void parser_free(void* ptr);
+
+  // Declared before the parser, which frees its memory when destroyed.
+  ParserMemory parser_memory_;
 
+  // What the page has used of the session's limits.
+  std::uint64_t document_bytes_ = 0;
+  std::uint64_t text_bytes_ = 0;
+  size_t var_bytes_ = 0;
+
+  std::unique_ptr<xml::fast_parser> fast_parser_;
   std::unique_ptr<XML_ParserStruct, decltype(&XML_ParserFree)> xml_parser_;
 
   std::vector<Element> stack_;
+
+  // The name of the element being started, kept to reuse its memory.
+  std::string element_name_;
   std::vector<std::unique_ptr<tty::Writer>> writer_stack_;
 
+  // The table being rendered, and the row being read.
+  std::unique_ptr<tty::Table> table_;
+  tty::Table::Row row_;
+
   std::vector<std::pair<std::string, std::string>> vars_;
   std::vector<Prompt> prompts_;
   std::string action_;
   std::string method_ = "GET";
 
+  // Performs the request unless `perform` is false.  A POST request sends
+  // `body`, unless `fields` are given.
+  Context(Session& session, const char* url, const char* method,
+          std::string body, std::vector<FormField> fields, bool perform);
+
+  void set_headers();
+
+  // Starts recording an exchange, if the session is being recorded.
+  void begin_exchange();
+
+  // Performs the request, and those of any redirects, until a page arrives.
+  void transfer();
+
+  CURLcode perform_transfer();
+
+  // Returns true if the response is a redirect to `location_`.
+  bool redirecting() const;
+
+  // If the response is a redirect, prepares the request for the new location
+  // and returns true.
+  bool follow_redirect();
+
+  void check_content_type() const;
+
+  bool has_files() const;
+
+  // Builds the request that submits the form with `answers`, one per prompt.
+  std::unique_ptr<Context> submit(const std::vector<std::string>& answers,
+                                  const std::string& encoded_vars,
+                                  bool perform) const;
+
+  // Completes parsing once the whole response has been received.
+  void end_document();
+
+  void set_body(const char* method, std::string&& body,
+                const std::vector<FormField>& fields);
+
+  std::unique_ptr<tty::Writer> make_line_writer() const;
+
+  // Writes a line of JSONL output.
+  void put_event(std::string event) const;
+
+  std::uint64_t microseconds_since_start() const;
+
+  void record(bool header, const void* buf, size_t size);
+
+  // Feeds a recorded response through `put_header` and `put`.
+  void replay(const recording::exchange& e);
+
   void put_header(const void* buf, size_t size);
   void put(const void* buf, size_t size);
 
+  // Creates the Expat parser, and if the fast parser was in use, hands the
+  // rest of the document over from it.
+  void switch_to_expat();
+
+  // Throws if Expat failed for lack of memory within the page's limit.
+  void check_parser_memory() const;
+
+  // Parser callbacks, shared by Expat and the fast parser.
+  static void on_start_element(void* user_data, const XML_Char* name,
+                               const XML_Char** atts);
+  static void on_end_element(void* user_data, const XML_Char* name);
+  static void on_character_data(void* user_data, const XML_Char* s, int len);
+
+  // Makes Expat return from XML_Parse once a callback has failed.
+  void stop_parser();
+
   void start_element(const XML_Char* name, const XML_Char** atts);
   void end_element(const XML_Char* name);
   void character_data(const XML_Char* s, int len);
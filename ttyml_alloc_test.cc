@@ -0,0 +1,176 @@
+// Checks that rendering a page allocates memory only in proportion to what
+// it keeps, so that new allocations in the hot paths of parsing and
+// rendering fail `make check`.
+
+#include "ttyml.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+
+#include "third_party/gtest/include/gtest/gtest.h"
+#include "util/recording_fixture.h"
+
+namespace {
+
+std::atomic<std::uint64_t> allocation_count;
+
+}  // namespace
+
+#ifdef __GLIBC__
+
+// Count every allocation, including those made by Expat and curl, and by
+// the default operator new.
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+
+}  // extern "C"
+
+#else
+
+void* operator new(std::size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (auto result = std::malloc(size ? size : 1)) return result;
+  throw std::bad_alloc{};
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+#endif
+
+namespace {
+
+// Makes a page with `count` copies of `body` inside `parent`, arriving in
+// parts of 16 KiB.
+recording::exchange make_page(const std::string& body, size_t count,
+                              const std::string& parent) {
+  std::string page = "<ttyml xmlns=\"https://ttyml.org/2018/05/26\">\n";
+  if (!parent.empty()) page += "<" + parent + ">";
+  for (size_t i = 0; i < count; ++i) page += body;
+  if (!parent.empty()) page += "</" + parent + ">";
+  page += "</ttyml>\n";
+
+  return recording::make_response(recording::kPageUrl, page, 16384);
+}
+
+// Runs with the fast parser, and with Expat alone.
+class AllocationTest : public testing::TestWithParam<bool> {
+ protected:
+  // Checks that each copy of `body` on a page, in `parent` if set, costs at
+  // most `budget` allocations, beyond those made once per page.
+  void check(const std::string& body, double budget,
+             const std::string& parent = "") {
+    static const size_t kCount = 2000;
+
+    // Leave out what is set up once per process.
+    count_allocations(make_page(body, 1, parent));
+
+    const auto small = count_allocations(make_page(body, kCount, parent));
+    const auto large = count_allocations(make_page(body, 2 * kCount, parent));
+
+    // Growing buffers account for a fraction of an allocation per copy.
+    EXPECT_LT(static_cast<double>(large - small) / kCount, budget + 0.1)
+        << body;
+  }
+
+ private:
+  // Returns the number of allocations made while rendering `page`.
+  std::uint64_t count_allocations(const recording::exchange& page) {
+    recording::player player{{page}};
+
+    ttyml::Session session;
+    session.output_format_ = ttyml::Session::OutputFormat::Plain;
+    session.output_ = &output_;
+    session.fast_xml_ = GetParam();
+    session.player_ = &player;
+    session.replay_delays_ = false;
+
+    const auto before = allocation_count.load();
+    ttyml::Context context{session, recording::kPageUrl};
+    return allocation_count.load() - before;
+  }
+
+  tty::OutputBuffer output_{open("/dev/null", O_WRONLY | O_CLOEXEC)};
+};
+
+// Each line has a writer, with a stack of styles.
+const double kPerLine = 2;
+
+// Styles cost nothing, until they nest deeper than before.
+const double kPerStyle = 0;
+const double kPerNestedStyle = 1;
+
+// Each row is written through a line writer.  Each cell collects its text
+// through a writer of its own, and takes a slot in the row, which grows by
+// doubling.
+const double kPerRow = 2;
+const double kPerCell = 3;
+
+const double kPerKiBOfText = 0;
+
+TEST_P(AllocationTest, Lines) {
+  check("<line>Hello, world</line>\n", kPerLine);
+  check("<line/>\n", kPerLine);
+}
+
+TEST_P(AllocationTest, Styles) {
+  check("<line>A <style fg=\"1\">red</style> and <style bold=\"1\">bold "
+        "</style> word</line>\n",
+        kPerLine + 2 * kPerStyle + kPerNestedStyle);
+  check("<line>A <style fg=\"1\">red <style bold=\"1\">bold <style "
+        "bg=\"4\">blue</style></style></style> word</line>\n",
+        kPerLine + 3 * kPerStyle + 2 * kPerNestedStyle);
+}
+
+TEST_P(AllocationTest, Text) {
+  // 4 KiB of text, with references and UTF-8.
+  std::string text;
+  while (text.size() < 4096)
+    text += "Some text, &amp; more text &#x2014; r\xc3\xa6kke, and more. ";
+  check("<line>" + text + "</line>\n", kPerLine + 4 * kPerKiBOfText);
+}
+
+TEST_P(AllocationTest, Table) {
+  check("<row><cell/><cell/><cell/></row>\n", kPerRow + 3 * kPerCell,
+        "table");
+
+  // A cell's characters are kept in a vector, which grows by doubling, five
+  // times for eleven characters.
+  check("<row><cell>Description</cell></row>\n", kPerRow + kPerCell + 5,
+        "table");
+}
+
+INSTANTIATE_TEST_CASE_P(Parser, AllocationTest, testing::Bool());
+
+}  // namespace
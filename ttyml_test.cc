@@ -0,0 +1,284 @@
+#include "ttyml.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "third_party/gtest/include/gtest/gtest.h"
+#include "util/recording_fixture.h"
+
+namespace {
+
+using recording::kPageUrl;
+using recording::make_chunk;
+using recording::make_response;
+
+const char kRoot[] = "<ttyml xmlns=\"https://ttyml.org/2018/05/26\">";
+
+// Returns a response to `method` `url` with a page of one line of `text`.
+recording::exchange make_line_page(const std::string& url,
+                                   const std::string& text,
+                                   const std::string& method = "GET") {
+  return make_response(
+      url, {string::cat(kRoot, "<line>", text, "</line></ttyml>")}, method);
+}
+
+// Returns a response to `method` `url` that redirects to `location`.
+recording::exchange make_redirect(const std::string& url, unsigned int status,
+                                  const std::string& location,
+                                  const std::string& method = "GET") {
+  recording::exchange e;
+  e.method = method;
+  e.url = url;
+  e.chunks.emplace_back(
+      make_chunk(true, string::cat("HTTP/1.1 ", status, " Moved\r\n")));
+  e.chunks.emplace_back(make_chunk(true, "Location: " + location + "\r\n"));
+  e.chunks.emplace_back(make_chunk(true, "\r\n"));
+  e.chunks.emplace_back(make_chunk(false, "Moved"));
+  return e;
+}
+
+std::string repeat(const std::string& text, size_t count) {
+  std::string result;
+  for (size_t i = 0; i < count; ++i) result += text;
+  return result;
+}
+
+// Loads pages from a recorded response, rendering them into a document.
+class ContextTest : public testing::Test {
+ protected:
+  ContextTest() {
+    session_.document_ = &document_;
+    session_.replay_delays_ = false;
+  }
+
+  // Loads a page whose body arrives in `chunks`, and returns the error
+  // message, if any.
+  std::string load(const std::vector<std::string>& chunks) {
+    return replay({make_response(kPageUrl, chunks)});
+  }
+
+  std::string load(const std::string& body) {
+    return load(std::vector<std::string>{body});
+  }
+
+  // Requests `url` with `method` and `data`, taking the responses from
+  // `exchanges`, and returns the error message, if any.  Only the last page
+  // is kept in the document.
+  std::string replay(std::vector<recording::exchange> exchanges,
+                     const char* url = kPageUrl, const char* method = "GET",
+                     const char* data = nullptr) {
+    document_.clear();
+
+    recording::player player{std::move(exchanges)};
+    session_.player_ = &player;
+
+    try {
+      ttyml::Context context{session_, url, method, data};
+    } catch (std::runtime_error& e) {
+      return e.what();
+    }
+    return "";
+  }
+
+  // Returns the first line of the document.
+  std::string first_line() {
+    std::string line;
+    if (!document_.empty()) document_.append_line(&line, 0);
+    return line;
+  }
+
+  tty::Document document_;
+  ttyml::Session session_;
+};
+
+TEST_F(ContextTest, Page) {
+  EXPECT_EQ("", load(std::vector<std::string>{kRoot, "<line>Hello, ",
+                                               "world</line><line/>",
+                                               "</ttyml>"}));
+  ASSERT_EQ(2U, document_.size());
+
+  std::string line;
+  document_.append_line(&line, 0);
+  EXPECT_EQ("Hello, world", line);
+}
+
+TEST_F(ContextTest, DocumentBytes) {
+  session_.limits_.document_bytes_ = 10000;
+
+  const auto line = repeat("x", 90);
+  std::vector<std::string> chunks{kRoot};
+  for (int i = 0; i < 100; ++i)
+    chunks.emplace_back("<line>" + line + "</line>");
+  chunks.emplace_back("</ttyml>");
+
+  EXPECT_EQ("page is larger than the limit of 10000 bytes", load(chunks));
+
+  // The page ends at the chunk that exceeds the limit.
+  EXPECT_GE(document_.size(), 90U);
+  EXPECT_LT(document_.size(), 100U);
+}
+
+TEST_F(ContextTest, EntityExpansion) {
+  session_.limits_.document_bytes_ = 100000;
+
+  // Each entity expands to ten of the previous one, for 10^6 bytes in all.
+  // That is too little for Expat's own protection against such documents.
+  std::string dtd = "<!DOCTYPE ttyml [<!ENTITY e0 \"xxxxxxxxxx\">";
+  for (int i = 1; i < 6; ++i) {
+    dtd += string::cat("<!ENTITY e", i, " \"",
+                       repeat(string::cat("&e", i - 1, ";"), 10), "\">");
+  }
+  dtd += "]>";
+
+  EXPECT_EQ("page text is longer than the limit of 100000 bytes",
+            load(dtd + kRoot + "<line>&e5;</line></ttyml>"));
+}
+
+TEST_F(ContextTest, Depth) {
+  session_.limits_.depth_ = 100;
+
+  EXPECT_EQ("", load(std::string{kRoot} + repeat("<x>", 99) +
+                     repeat("</x>", 99) + "</ttyml>"));
+  EXPECT_EQ("page nests elements deeper than the limit of 100",
+            load(std::string{kRoot} + repeat("<x>", 100000) + "</ttyml>"));
+}
+
+TEST_F(ContextTest, Vars) {
+  session_.limits_.vars_ = 10;
+  session_.limits_.var_bytes_ = 1000;
+
+  EXPECT_EQ("", load(std::string{kRoot} +
+                     repeat("<var name='a' value='b'/>", 10) + "</ttyml>"));
+  EXPECT_EQ("page has more vars than the limit of 10",
+            load(std::string{kRoot} +
+                 repeat("<var name='a' value='b'/>", 11) + "</ttyml>"));
+  EXPECT_EQ("page has more var data than the limit of 1000 bytes",
+            load(std::string{kRoot} + "<var name='a' value='" +
+                 repeat("b", 1000) + "'/></ttyml>"));
+}
+
+TEST_F(ContextTest, Prompts) {
+  session_.limits_.prompts_ = 10;
+
+  EXPECT_EQ("page has more prompts than the limit of 10",
+            load(std::string{kRoot} + "<form>" +
+                 repeat("<prompt name='a'/>", 11) + "</form></ttyml>"));
+}
+
+TEST_F(ContextTest, RegexSize) {
+  session_.limits_.regex_size_ = 1000;
+
+  EXPECT_EQ("", load(std::string{kRoot} +
+                     "<form><prompt name='a' filter-regex='[0-9]{1,5}-"
+                     "[a-z{}]+(x|y){10,}'/></form></ttyml>"));
+  EXPECT_EQ("filter-regex '(a{100}b){100}' is larger than the limit of 1000",
+            load(std::string{kRoot} +
+                 "<form><prompt name='a' filter-regex='(a{100}b){100}'/>"
+                 "</form></ttyml>"));
+  EXPECT_EQ("filter-regex '((a{1000}){1000}){1000}' is larger than the limit "
+            "of 1000",
+            load(std::string{kRoot} +
+                 "<form><prompt name='a' "
+                 "filter-regex='((a{1000}){1000}){1000}'/></form></ttyml>"));
+}
+
+TEST_F(ContextTest, ParserMemory) {
+  session_.limits_.parser_memory_ = 1 << 20;
+
+  // A tag too long for the fast parser is left to Expat, which keeps all of
+  // it in memory.
+  const auto page = std::string{kRoot} + "<var name='a' value='" +
+                    repeat("b", 4 << 20) + "'/></ttyml>";
+  std::vector<std::string> chunks;
+  for (size_t i = 0; i < page.size(); i += 16384)
+    chunks.emplace_back(page.substr(i, 16384));
+
+  const std::string error =
+      "page needs more than the limit of 1048576 bytes of parser memory";
+  EXPECT_EQ(error, load(chunks));
+
+  session_.fast_xml_ = false;
+  EXPECT_EQ(error, load(chunks));
+}
+
+TEST_F(ContextTest, RelativeRedirect) {
+  EXPECT_EQ("", replay({make_redirect("http://localhost/a/b?q=1", 302,
+                                      "c/../d?x=1"),
+                        make_redirect("http://localhost/a/d?x=1", 302, "e"),
+                        make_redirect("http://localhost/a/e", 302, "/f"),
+                        make_redirect("http://localhost/f", 302,
+                                      "//example.org/g"),
+                        make_line_page("http://example.org/g", "Moved")},
+                       "http://localhost/a/b?q=1"));
+  EXPECT_EQ("Moved", first_line());
+}
+
+TEST_F(ContextTest, RedirectMethod) {
+  // 301, 302 and 303 turn a POST into a GET, while 307 and 308 repeat it.
+  for (const auto status : {301U, 302U, 303U}) {
+    EXPECT_EQ("", replay({make_redirect(kPageUrl, status, "/next", "POST"),
+                          make_line_page("http://localhost/next", "Next")},
+                         kPageUrl, "POST", "a=b"))
+        << status;
+    EXPECT_EQ("Next", first_line());
+  }
+
+  for (const auto status : {307U, 308U}) {
+    EXPECT_EQ("", replay({make_redirect(kPageUrl, status, "/next", "POST"),
+                          make_line_page("http://localhost/next", "Next",
+                                         "POST")},
+                         kPageUrl, "POST", "a=b"))
+        << status;
+    EXPECT_EQ("Next", first_line());
+  }
+}
+
+TEST_F(ContextTest, PermanentRedirect) {
+  // Temporary redirects are followed every time.
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ("", replay({make_redirect(kPageUrl, 302, "/temporary"),
+                          make_line_page("http://localhost/temporary", "")}));
+  }
+
+  // A 301 is remembered for GET, and requests go straight to the new
+  // location, following it further if it too has moved.
+  EXPECT_EQ("", replay({make_redirect(kPageUrl, 301, "/moved"),
+                        make_redirect("http://localhost/moved", 308, "/new"),
+                        make_line_page("http://localhost/new", "New")}));
+  EXPECT_EQ("New", first_line());
+  EXPECT_EQ("", replay({make_line_page("http://localhost/new", "New")}));
+  EXPECT_EQ("New", first_line());
+
+  // A 301 does not apply to POST, but a 308 does.
+  EXPECT_EQ("", replay({make_redirect(kPageUrl, 301, "/moved", "POST"),
+                        make_line_page("http://localhost/moved", "")},
+                       kPageUrl, "POST", "a=b"));
+  EXPECT_EQ("", replay({make_line_page("http://localhost/new", "", "POST")},
+                       "http://localhost/moved", "POST", "a=b"));
+}
+
+TEST_F(ContextTest, TooManyRedirects) {
+  std::vector<recording::exchange> exchanges;
+  for (int i = 0; i < 10; ++i) {
+    exchanges.emplace_back(
+        make_redirect(string::cat("http://localhost/", i), 302,
+                      string::cat("/", i + 1)));
+  }
+  exchanges.emplace_back(make_line_page("http://localhost/10", "Ten"));
+  EXPECT_EQ("", replay(exchanges, "http://localhost/0"));
+  EXPECT_EQ("Ten", first_line());
+
+  exchanges.back() = make_redirect("http://localhost/10", 302, "/11");
+  EXPECT_EQ("too many redirects, the last to '/11'",
+            replay(exchanges, "http://localhost/0"));
+
+  // Loops are cut short the same way.
+  EXPECT_EQ("too many redirects, the last to '/'",
+            replay(std::vector<recording::exchange>(
+                       11, make_redirect("http://localhost/", 302, "/")),
+                   "http://localhost/"));
+}
+
+}  // namespace
+
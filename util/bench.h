@@ -0,0 +1,96 @@
+#pragma once
+
+// A small timing harness for microbenchmarks.
+//
+// This header replaces the global operator new and delete to count
+// allocations, so it must be included by exactly one translation unit: the
+// benchmark program's own.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace bench {
+
+namespace internal {
+
+inline std::uint64_t& allocation_count() {
+  static std::uint64_t count;
+  return count;
+}
+
+}  // namespace internal
+
+// Keeps the compiler from optimizing away the computation of `value`.
+template <typename T>
+void do_not_optimize(const T& value) {
+  asm volatile("" : : "r"(&value) : "memory");
+}
+
+struct result {
+  std::uint64_t iterations = 0;
+  double ns_per_op = 0;
+  double allocs_per_op = 0;
+};
+
+// Calls `f` repeatedly for at least `min_seconds`, and prints the time and
+// number of allocations per call under `name`.  If each call performs
+// `ops_per_call` operations, the numbers are given per operation instead.
+template <typename Function>
+result run(const char* name, Function&& f, std::uint64_t ops_per_call = 1,
+           double min_seconds = 0.1) {
+  using clock = std::chrono::steady_clock;
+
+  f();
+
+  result r;
+  std::uint64_t iterations = 1;
+
+  for (;;) {
+    const auto allocations = internal::allocation_count();
+    const auto start = clock::now();
+    for (std::uint64_t i = 0; i < iterations; ++i) f();
+    const auto elapsed =
+        std::chrono::duration<double>(clock::now() - start).count();
+
+    if (elapsed >= min_seconds || iterations >= (UINT64_C(1) << 40)) {
+      const double ops = static_cast<double>(iterations) * ops_per_call;
+      r.iterations = iterations;
+      r.ns_per_op = elapsed * 1e9 / ops;
+      r.allocs_per_op = (internal::allocation_count() - allocations) / ops;
+      break;
+    }
+
+    // Aim slightly past the target, so that the next round usually suffices.
+    const auto scale = (elapsed > 0) ? 1.2 * min_seconds / elapsed : 100.0;
+    iterations = std::max<std::uint64_t>(
+        iterations + 1, iterations * std::min(scale, 100.0));
+  }
+
+  std::printf("%-32s %12.1f ns/op %10.2f allocs/op\n", name, r.ns_per_op,
+              r.allocs_per_op);
+  std::fflush(stdout);
+
+  return r;
+}
+
+}  // namespace bench
+
+void* operator new(std::size_t size) {
+  ++bench::internal::allocation_count();
+  if (auto result = std::malloc(size ? size : 1)) return result;
+  throw std::bad_alloc{};
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
@@ -0,0 +1,82 @@
+#pragma once
+
+// Prefix lookups over large lists of completion candidates.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace completion {
+
+// A sorted list of strings, stored as one NUL separated buffer plus a 32-bit
+// offset per entry.
+class sorted_list {
+ public:
+  sorted_list() = default;
+
+  // Takes ownership of a newline or CRLF separated list of candidates.  Empty
+  // lines and duplicates are discarded.
+  explicit sorted_list(std::string text) : text_{std::move(text)} {
+    if (text_.size() >= UINT32_MAX)
+      throw std::runtime_error{"completion list too large"};
+
+    if (!text_.empty() && text_.back() != '\n') text_.push_back('\n');
+
+    std::uint32_t begin = 0;
+    for (std::uint32_t i = 0; i != text_.size(); ++i) {
+      if (text_[i] != '\n') continue;
+      text_[i] = 0;
+      // Lines may also end in CRLF.
+      auto end = i;
+      if (end > begin && text_[end - 1] == '\r') text_[--end] = 0;
+      if (end > begin) offsets_.emplace_back(begin);
+      begin = i + 1;
+    }
+
+    std::sort(offsets_.begin(), offsets_.end(),
+              [this](std::uint32_t lhs, std::uint32_t rhs) {
+                return std::strcmp(at(lhs), at(rhs)) < 0;
+              });
+
+    offsets_.erase(std::unique(offsets_.begin(), offsets_.end(),
+                               [this](std::uint32_t lhs, std::uint32_t rhs) {
+                                 return 0 == std::strcmp(at(lhs), at(rhs));
+                               }),
+                   offsets_.end());
+    offsets_.shrink_to_fit();
+  }
+
+  size_t size() const { return offsets_.size(); }
+
+  const char* operator[](size_t idx) const { return at(offsets_[idx]); }
+
+  // Returns the range of indexes whose entries start with `prefix`.
+  std::pair<size_t, size_t> find_prefix(const char* prefix) const {
+    const auto prefix_length = std::strlen(prefix);
+
+    const auto begin = std::lower_bound(
+        offsets_.begin(), offsets_.end(), prefix,
+        [this](std::uint32_t offset, const char* prefix) {
+          return std::strcmp(at(offset), prefix) < 0;
+        });
+
+    const auto end = std::partition_point(
+        begin, offsets_.end(), [this, prefix, prefix_length](std::uint32_t o) {
+          return 0 == std::strncmp(at(o), prefix, prefix_length);
+        });
+
+    return {begin - offsets_.begin(), end - offsets_.begin()};
+  }
+
+ private:
+  const char* at(std::uint32_t offset) const { return text_.data() + offset; }
+
+  std::string text_;
+  std::vector<std::uint32_t> offsets_;
+};
+
+}  // namespace completion
@@ -0,0 +1,60 @@
+#include "util/completion.h"
+
+#include "third_party/gtest/include/gtest/gtest.h"
+
+namespace {
+
+std::vector<std::string> matches(const completion::sorted_list& list,
+                                 const char* prefix) {
+  std::vector<std::string> result;
+  const auto range = list.find_prefix(prefix);
+  for (auto i = range.first; i != range.second; ++i)
+    result.emplace_back(list[i]);
+  return result;
+}
+
+TEST(CompletionTest, Prefix) {
+  const completion::sorted_list list{"db2\nweb1\ndb1\nweb10\ncache\n"};
+
+  EXPECT_EQ(5U, list.size());
+  EXPECT_EQ((std::vector<std::string>{"db1", "db2"}), matches(list, "db"));
+  EXPECT_EQ((std::vector<std::string>{"web1", "web10"}), matches(list, "web1"));
+  EXPECT_EQ((std::vector<std::string>{"web10"}), matches(list, "web10"));
+  EXPECT_EQ((std::vector<std::string>{}), matches(list, "web100"));
+  EXPECT_EQ((std::vector<std::string>{}), matches(list, "zzz"));
+  EXPECT_EQ(5U, matches(list, "").size());
+}
+
+TEST(CompletionTest, Duplicates) {
+  const completion::sorted_list list{"a\n\nb\na\nb"};
+
+  EXPECT_EQ((std::vector<std::string>{"a", "b"}), matches(list, ""));
+}
+
+TEST(CompletionTest, CrLf) {
+  const completion::sorted_list list{"db2\r\n\r\ndb1\r\ndb1\nweb\r"};
+
+  EXPECT_EQ((std::vector<std::string>{"db1", "db2", "web"}),
+            matches(list, ""));
+}
+
+TEST(CompletionTest, Empty) {
+  const completion::sorted_list list;
+
+  EXPECT_EQ(0U, list.size());
+  EXPECT_EQ((std::vector<std::string>{}), matches(list, ""));
+}
+
+TEST(CompletionTest, Large) {
+  std::string text;
+  for (int i = 0; i < 200000; ++i) text += "host-" + std::to_string(i) + '\n';
+
+  const completion::sorted_list list{std::move(text)};
+
+  EXPECT_EQ(200000U, list.size());
+  EXPECT_EQ(111U, matches(list, "host-1234").size());
+  EXPECT_EQ((std::vector<std::string>{"host-199999"}),
+            matches(list, "host-199999"));
+}
+
+}  // namespace
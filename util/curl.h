@@ -3,6 +3,9 @@
 // Helper functions for dealing with the cURL library.
 
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
 
 #include <curl/curl.h>
 
@@ -27,6 +30,30 @@ class string_list
   void append(const std::string& str) { append(str.c_str()); }
 };
 
+// Data shared between easy handles, such as the DNS cache, TLS sessions and
+// open connections.
+class share : public std::unique_ptr<CURLSH, decltype(&curl_share_cleanup)> {
+ public:
+  share()
+      : std::unique_ptr<CURLSH, decltype(&curl_share_cleanup)>{
+            curl_share_init(), curl_share_cleanup} {
+    if (!get()) throw std::runtime_error{"curl_share_init failed"};
+  }
+
+  void add(curl_lock_data data) {
+    const auto ret = curl_share_setopt(get(), CURLSHOPT_SHARE, data);
+    if (ret != CURLSHE_OK)
+      throw std::runtime_error{string::cat("curl_share_setopt failed: ",
+                                           curl_share_strerror(ret))};
+  }
+};
+
+inline void check(CURLcode ret, const char* function) {
+  if (ret != CURLE_OK)
+    throw std::runtime_error{
+        string::cat(function, " failed: ", curl_easy_strerror(ret))};
+}
+
 template <typename... Args>
 void setopt(CURL* curl, CURLoption option, Args&&... args) {
   const auto ret = curl_easy_setopt(curl, option, args...);
@@ -35,4 +62,16 @@ void setopt(CURL* curl, CURLoption option, Args&&... args) {
         string::cat("curl_easy_setopt failed: ", curl_easy_strerror(ret))};
 }
 
+// Sets the options that every request of a session has in common: sharing
+// through `share` if set, verifying server certificates against `ca_file` if
+// not empty, accepting compressed responses, and sending `user_agent`.
+inline void set_session_options(CURL* curl, CURLSH* share,
+                                const std::string& ca_file,
+                                const char* user_agent) {
+  if (share) setopt(curl, CURLOPT_SHARE, share);
+  if (!ca_file.empty()) setopt(curl, CURLOPT_CAINFO, ca_file.c_str());
+  setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip,deflate");
+  setopt(curl, CURLOPT_USERAGENT, user_agent);
+}
+
 }  // namespace curl
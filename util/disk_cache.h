@@ -0,0 +1,167 @@
+#pragma once
+
+// A small on-disk map with expiring entries, which concurrent processes can
+// update without losing each other's changes.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util/string.h"
+
+namespace disk_cache {
+
+struct entry {
+  std::time_t expires = 0;
+  std::string value;
+
+  bool operator==(const entry& rhs) const {
+    return expires == rhs.expires && value == rhs.value;
+  }
+};
+
+using map = std::map<std::string, entry>;
+
+namespace internal {
+
+inline int hex_value(char ch) {
+  if (ch >= '0' && ch <= '9') return ch - '0';
+  if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+  return -1;
+}
+
+class fd_closer {
+ public:
+  explicit fd_closer(int fd) : fd_{fd} {}
+  ~fd_closer() { close(fd_); }
+
+ private:
+  int fd_;
+};
+
+}  // namespace internal
+
+// Reads the entries stored in `path` that have not expired at `now`.  A
+// missing file holds no entries.
+inline map load(const std::string& path, std::time_t now) {
+  map result;
+
+  const auto file = std::fopen(path.c_str(), "re");
+  if (!file) {
+    if (errno == ENOENT) return result;
+    throw std::system_error{errno, std::system_category(),
+                            string::cat("opening ", path, " failed")};
+  }
+
+  // Each line is "<expires> <key> <hex encoded value>".
+  char* line = nullptr;
+  size_t line_size = 0;
+  while (-1 != getline(&line, &line_size, file)) {
+    char* p = line;
+    const auto expires = std::strtoll(p, &p, 10);
+    if (*p++ != ' ' || expires <= now) continue;
+
+    const auto key_begin = p;
+    while (*p && *p != ' ') ++p;
+    if (*p != ' ' || p == key_begin) continue;
+    std::string key{key_begin, p++};
+
+    entry e;
+    e.expires = expires;
+    for (; p[0] && p[0] != '\n'; p += 2) {
+      const auto high = internal::hex_value(p[0]);
+      const auto low = internal::hex_value(p[1]);
+      if (high < 0 || low < 0) break;
+      e.value.push_back(high << 4 | low);
+    }
+    if (p[0] && p[0] != '\n') continue;
+
+    result[std::move(key)] = std::move(e);
+  }
+
+  std::free(line);
+  std::fclose(file);
+
+  return result;
+}
+
+// Adds `updates` to the entries stored in `path`, dropping entries that have
+// expired at `now`.  Writers are serialized by a lock file next to `path`,
+// and the new contents are renamed into place, so readers never see a partial
+// file.  The files are only accessible to the current user.
+inline void store(const std::string& path, const map& updates,
+                  std::time_t now) {
+  const auto lock_path = path + ".lock";
+  const auto lock_fd =
+      open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (lock_fd == -1)
+    throw std::system_error{errno, std::system_category(),
+                            string::cat("opening ", lock_path, " failed")};
+  internal::fd_closer lock_closer{lock_fd};
+
+  while (-1 == flock(lock_fd, LOCK_EX)) {
+    if (errno != EINTR)
+      throw std::system_error{errno, std::system_category(),
+                              string::cat("locking ", lock_path, " failed")};
+  }
+
+  auto entries = load(path, now);
+  for (const auto& update : updates) {
+    if (update.second.expires > now) entries[update.first] = update.second;
+  }
+
+  std::string data;
+  static const char hex_digits[] = "0123456789abcdef";
+  for (const auto& e : entries) {
+    data.append(std::to_string(e.second.expires));
+    data.push_back(' ');
+    data.append(e.first);
+    data.push_back(' ');
+    for (const auto ch : e.second.value) {
+      data.push_back(hex_digits[static_cast<unsigned char>(ch) >> 4]);
+      data.push_back(hex_digits[static_cast<unsigned char>(ch) & 15]);
+    }
+    data.push_back('\n');
+  }
+
+  const auto tmp_path = string::cat(path, ".tmp.", getpid());
+  const auto fd = open(tmp_path.c_str(),
+                       O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd == -1)
+    throw std::system_error{errno, std::system_category(),
+                            string::cat("creating ", tmp_path, " failed")};
+
+  size_t offset = 0;
+  while (offset < data.size()) {
+    const auto ret = write(fd, data.data() + offset, data.size() - offset);
+    if (ret == -1) {
+      if (errno == EINTR) continue;
+      const auto error = errno;
+      close(fd);
+      unlink(tmp_path.c_str());
+      throw std::system_error{error, std::system_category(),
+                              string::cat("writing ", tmp_path, " failed")};
+    }
+    offset += ret;
+  }
+
+  close(fd);
+
+  if (-1 == rename(tmp_path.c_str(), path.c_str())) {
+    const auto error = errno;
+    unlink(tmp_path.c_str());
+    throw std::system_error{error, std::system_category(),
+                            string::cat("renaming ", tmp_path, " failed")};
+  }
+}
+
+}  // namespace disk_cache
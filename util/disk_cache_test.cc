@@ -0,0 +1,108 @@
+#include "util/disk_cache.h"
+
+#include <sys/wait.h>
+
+#include "third_party/gtest/include/gtest/gtest.h"
+
+namespace {
+
+class DiskCacheTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    char directory[] = "/tmp/disk_cache_test.XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(directory));
+    directory_ = directory;
+    path_ = directory_ + "/cache";
+  }
+
+  void TearDown() override {
+    unlink(path_.c_str());
+    unlink((path_ + ".lock").c_str());
+    rmdir(directory_.c_str());
+  }
+
+  std::string directory_;
+  std::string path_;
+};
+
+disk_cache::entry make_entry(std::time_t expires, std::string value) {
+  disk_cache::entry result;
+  result.expires = expires;
+  result.value = std::move(value);
+  return result;
+}
+
+TEST_F(DiskCacheTest, Missing) {
+  EXPECT_TRUE(disk_cache::load(path_, 1000).empty());
+}
+
+TEST_F(DiskCacheTest, RoundTrip) {
+  disk_cache::map entries;
+  entries["example.org:443"] = make_entry(2000, "192.0.2.1");
+  entries["binary"] = make_entry(2000, std::string("\0\n \xff", 4));
+
+  disk_cache::store(path_, entries, 1000);
+
+  EXPECT_EQ(entries, disk_cache::load(path_, 1000));
+}
+
+TEST_F(DiskCacheTest, Expiry) {
+  disk_cache::map entries;
+  entries["a"] = make_entry(1500, "1");
+  entries["b"] = make_entry(2500, "2");
+  entries["c"] = make_entry(500, "3");
+
+  disk_cache::store(path_, entries, 1000);
+
+  EXPECT_EQ(2U, disk_cache::load(path_, 1000).size());
+  EXPECT_EQ(1U, disk_cache::load(path_, 2000).size());
+  EXPECT_EQ(0U, disk_cache::load(path_, 3000).size());
+}
+
+TEST_F(DiskCacheTest, Merge) {
+  disk_cache::map first, second;
+  first["a"] = make_entry(2000, "1");
+  first["b"] = make_entry(2000, "2");
+  second["b"] = make_entry(3000, "3");
+
+  disk_cache::store(path_, first, 1000);
+  disk_cache::store(path_, second, 1000);
+
+  const auto entries = disk_cache::load(path_, 1000);
+  ASSERT_EQ(2U, entries.size());
+  EXPECT_EQ("1", entries.at("a").value);
+  EXPECT_EQ("3", entries.at("b").value);
+}
+
+// Processes storing different keys at the same time must not lose each
+// other's entries.
+TEST_F(DiskCacheTest, Concurrent) {
+  static const int kProcesses = 8;
+  static const int kIterations = 20;
+
+  std::vector<pid_t> children;
+  for (int i = 0; i < kProcesses; ++i) {
+    const auto pid = fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0) {
+      for (int j = 0; j < kIterations; ++j) {
+        disk_cache::map entries;
+        entries[string::cat("key-", i, "-", j)] = make_entry(2000, "value");
+        disk_cache::store(path_, entries, 1000);
+      }
+      _exit(0);
+    }
+    children.emplace_back(pid);
+  }
+
+  for (const auto pid : children) {
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+
+  EXPECT_EQ(static_cast<size_t>(kProcesses * kIterations),
+            disk_cache::load(path_, 1000).size());
+}
+
+}  // namespace
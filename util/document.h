@@ -0,0 +1,224 @@
+#pragma once
+
+// A compact, append-only store of rendered lines, for showing long output in
+// a pager.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "util/screen.h"
+#include "util/tty.h"
+#include "util/utf8.h"
+
+namespace tty {
+
+// Holds the text of all lines back to back in fixed size chunks, with styles
+// stored as spans that start wherever the style changes, rather than as
+// escape sequences.  Each line costs four bytes beyond its text, finding a
+// line takes constant time, and growing never copies earlier text.
+class Document {
+ public:
+  // Appends text to the current line.
+  void put(const char* text, size_t len) {
+    while (len > 0) {
+      const auto offset = size_ % kChunkSize;
+      if (!offset && size_ / kChunkSize == chunks_.size())
+        chunks_.emplace_back(new char[kChunkSize]);
+
+      const auto amount = std::min<size_t>(len, kChunkSize - offset);
+      std::memcpy(chunks_[size_ / kChunkSize].get() + offset, text, amount);
+      size_ += amount;
+      text += amount;
+      len -= amount;
+    }
+  }
+
+  // Sets the style of subsequently appended text.
+  void set_style(const Style& style) {
+    if (style == (spans_.empty() ? Style{} : spans_.back().style_)) return;
+
+    if (!spans_.empty() && spans_.back().offset_ == size_) {
+      spans_.back().style_ = style;
+      // Drop the span if it no longer changes anything.
+      if (style == (spans_.size() > 1 ? spans_[spans_.size() - 2].style_
+                                      : Style{}))
+        spans_.pop_back();
+      return;
+    }
+
+    spans_.emplace_back();
+    spans_.back().offset_ = size_;
+    spans_.back().style_ = style;
+  }
+
+  // Completes the current line.
+  void end_line() {
+    if (!(starts_.size() % kBlockSize)) blocks_.emplace_back(line_start_);
+
+    const auto relative_start = line_start_ - blocks_.back();
+    if (relative_start > UINT32_MAX)
+      throw std::length_error{"document lines too long"};
+
+    starts_.emplace_back(relative_start);
+    line_start_ = size_;
+  }
+
+  // Returns the number of complete lines.
+  size_t size() const { return starts_.size(); }
+
+  bool empty() const { return starts_.empty(); }
+
+  void clear() {
+    chunks_.clear();
+    size_ = 0;
+    spans_.clear();
+    blocks_.clear();
+    starts_.clear();
+    line_start_ = 0;
+  }
+
+  // Stores in `cells` the cells of line `index` that fit in `columns`
+  // columns, or all cells if `columns` is zero.
+  void line(size_t index, unsigned int columns,
+            std::vector<Cell>* cells) const {
+    cells->clear();
+
+    const auto begin = line_begin(index);
+    const auto end = line_end(index);
+
+    auto span = span_at(begin);
+    auto style = (span == spans_.begin()) ? Style{} : span[-1].style_;
+
+    unsigned int column = 0;
+
+    std::string scratch;
+    const auto text = contiguous(begin, end, &scratch);
+
+    auto p = text;
+    const auto text_end = text + (end - begin);
+    while (p != text_end) {
+      const auto offset = begin + (p - text);
+      while (span != spans_.end() && span->offset_ <= offset)
+        style = (span++)->style_;
+
+      const auto ch = utf8::decode(&p, text_end);
+      const auto ch_width = utf8::width(ch);
+      if (!ch_width) continue;
+      if (columns && column + ch_width > columns) break;
+
+      cells->emplace_back();
+      cells->back().ch_ = ch;
+      cells->back().style_ = style;
+      column += ch_width;
+    }
+  }
+
+  // Appends line `index` to `output` with escape sequences for its styles,
+  // ending in the default style.
+  void append_line(std::string* output, size_t index) const {
+    const auto begin = line_begin(index);
+    const auto end = line_end(index);
+
+    auto span = span_at(begin);
+    const auto initial_style =
+        (span == spans_.begin()) ? Style{} : span[-1].style_;
+
+    append_transition(output, Style{}, initial_style);
+    auto style = initial_style;
+
+    auto offset = begin;
+    for (; span != spans_.end() && span->offset_ < end; ++span) {
+      append_text(output, offset, span->offset_);
+      append_transition(output, style, span->style_);
+      style = span->style_;
+      offset = span->offset_;
+    }
+    append_text(output, offset, end);
+
+    append_transition(output, style, Style{});
+  }
+
+ private:
+  enum : size_t { kBlockSize = 1024, kChunkSize = 1 << 20 };
+
+  struct Span {
+    std::uint64_t offset_;
+    Style style_;
+  };
+
+  std::uint64_t line_begin(size_t index) const {
+    return blocks_[index / kBlockSize] + starts_[index];
+  }
+
+  std::uint64_t line_end(size_t index) const {
+    return (index + 1 < starts_.size()) ? line_begin(index + 1) : line_start_;
+  }
+
+  // Appends the text between two offsets to `output`.
+  void append_text(std::string* output, std::uint64_t begin,
+                   std::uint64_t end) const {
+    while (begin < end) {
+      const auto offset = begin % kChunkSize;
+      const auto amount = std::min<std::uint64_t>(end - begin,
+                                                  kChunkSize - offset);
+      output->append(chunks_[begin / kChunkSize].get() + offset, amount);
+      begin += amount;
+    }
+  }
+
+  // Returns the text between two offsets, copying it to `scratch` if it
+  // crosses a chunk boundary.
+  const char* contiguous(std::uint64_t begin, std::uint64_t end,
+                         std::string* scratch) const {
+    if (begin == end) return "";
+    if (begin / kChunkSize == (end - 1) / kChunkSize)
+      return chunks_[begin / kChunkSize].get() + begin % kChunkSize;
+
+    append_text(scratch, begin, end);
+    return scratch->data();
+  }
+
+  // Returns the first span starting after `offset`.
+  std::vector<Span>::const_iterator span_at(std::uint64_t offset) const {
+    return std::upper_bound(spans_.begin(), spans_.end(), offset,
+                            [](std::uint64_t lhs, const Span& rhs) {
+                              return lhs < rhs.offset_;
+                            });
+  }
+
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  std::uint64_t size_ = 0;
+
+  std::vector<Span> spans_;
+
+  // Line i starts at offset blocks_[i / kBlockSize] + starts_[i] of the text.
+  std::vector<std::uint64_t> blocks_;
+  std::vector<std::uint32_t> starts_;
+
+  // Where the current, incomplete line starts.
+  std::uint64_t line_start_ = 0;
+};
+
+// Renders lines into a document.
+class DocumentWriter : public Writer {
+ public:
+  DocumentWriter(Document& document) : document_{document} {}
+
+  void put(const char* text, size_t len) final { document_.put(text, len); }
+
+  void transition(const Style& from, const Style& to) final {
+    document_.set_style(to);
+  }
+
+  void end_line() final { document_.end_line(); }
+
+ private:
+  Document& document_;
+};
+
+}  // namespace tty
@@ -0,0 +1,66 @@
+// Measures building a 10 million line document, and drawing and scrolling
+// its viewport, which should not depend on the document's length.
+
+#include <cstdio>
+#include <string>
+
+#include <sys/resource.h>
+
+#include "util/bench.h"
+#include "util/document.h"
+#include "util/pager.h"
+
+int main() {
+  static const size_t kLines = 10000000;
+
+  tty::Document document;
+  tty::Style highlight;
+  highlight.fg_ = 1;
+
+  bench::run(
+      "Document::put/end_line",
+      [&] {
+        document.clear();
+        std::string text;
+        for (size_t i = 0; i < kLines; ++i) {
+          text = "host-";
+          text += std::to_string(i % 977);
+          text += ".example.org  load ";
+          document.put(text.data(), text.size());
+          if (!(i % 10)) document.set_style(highlight);
+          document.put("0.42", 4);
+          if (!(i % 10)) document.set_style(tty::Style{});
+          document.end_line();
+        }
+      },
+      kLines, 0);
+
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  std::printf("%zu lines, peak RSS %ld KiB\n", document.size(),
+              usage.ru_maxrss);
+
+  const size_t steps = 1000;
+  size_t top = 0;
+
+  tty::Screen previous, current;
+  std::string output;
+
+  for (const auto start : {size_t{0}, kLines / 2, kLines - 2 * steps}) {
+    top = start;
+    bench::run(
+        start ? (start == kLines / 2 ? "scroll at middle" : "scroll at end")
+              : "scroll at top",
+        [&] {
+          for (size_t i = 0; i < steps; ++i) {
+            tty::viewport(&current, document, top++, 80, 23);
+            output.clear();
+            tty::diff(&output, previous, current);
+            bench::do_not_optimize(output);
+            std::swap(previous, current);
+          }
+          top = start;
+        },
+        steps);
+  }
+}
@@ -0,0 +1,186 @@
+#include "util/document.h"
+#include "util/pager.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "third_party/gtest/include/gtest/gtest.h"
+
+namespace {
+
+void add_line(tty::Document* document, const std::string& text) {
+  document->put(text.data(), text.size());
+  document->end_line();
+}
+
+std::string cells_text(const std::vector<tty::Cell>& cells) {
+  std::string result;
+  for (const auto& cell : cells) utf8::encode(&result, cell.ch_);
+  return result;
+}
+
+tty::Style make_style(unsigned int fg, bool bold = false) {
+  tty::Style result;
+  result.fg_ = fg;
+  result.bold_ = bold;
+  return result;
+}
+
+TEST(DocumentTest, Lines) {
+  tty::Document document;
+  EXPECT_TRUE(document.empty());
+
+  add_line(&document, "first");
+  add_line(&document, "");
+  document.put("th", 2);
+  EXPECT_EQ(2U, document.size());
+  document.put("ird", 3);
+  document.end_line();
+
+  ASSERT_EQ(3U, document.size());
+
+  std::vector<tty::Cell> cells;
+  document.line(0, 0, &cells);
+  EXPECT_EQ("first", cells_text(cells));
+  document.line(1, 0, &cells);
+  EXPECT_EQ("", cells_text(cells));
+  document.line(2, 0, &cells);
+  EXPECT_EQ("third", cells_text(cells));
+
+  document.clear();
+  EXPECT_TRUE(document.empty());
+  add_line(&document, "again");
+  document.line(0, 0, &cells);
+  EXPECT_EQ("again", cells_text(cells));
+}
+
+TEST(DocumentTest, ManyLines) {
+  tty::Document document;
+  for (int i = 0; i < 5000; ++i) add_line(&document, std::to_string(i));
+
+  ASSERT_EQ(5000U, document.size());
+
+  std::vector<tty::Cell> cells;
+  for (int i : {0, 1023, 1024, 1025, 4999}) {
+    document.line(i, 0, &cells);
+    EXPECT_EQ(std::to_string(i), cells_text(cells));
+  }
+}
+
+TEST(DocumentTest, LinesAcrossChunks) {
+  tty::Document document;
+  add_line(&document, std::string(700000, 'a'));
+  add_line(&document, std::string(700000, 'b') + "\xc3\xa6");
+
+  std::vector<tty::Cell> cells;
+  document.line(1, 0, &cells);
+  ASSERT_EQ(700001U, cells.size());
+  EXPECT_EQ(U'b', cells.front().ch_);
+  EXPECT_EQ(U'\u00e6', cells.back().ch_);
+
+  std::string output;
+  document.append_line(&output, 1);
+  EXPECT_EQ(std::string(700000, 'b') + "\xc3\xa6", output);
+}
+
+TEST(DocumentTest, Columns) {
+  tty::Document document;
+  // U+6F22 is two columns wide.
+  add_line(&document, "ab\xe6\xbc\xa2" "cd");
+
+  std::vector<tty::Cell> cells;
+  document.line(0, 3, &cells);
+  EXPECT_EQ("ab", cells_text(cells));
+  document.line(0, 4, &cells);
+  EXPECT_EQ("ab\xe6\xbc\xa2", cells_text(cells));
+}
+
+TEST(DocumentTest, Styles) {
+  tty::Document document;
+
+  document.put("a", 1);
+  document.set_style(make_style(1));
+  document.put("b", 1);
+  document.set_style(make_style(1, true));
+  document.set_style(make_style(1));
+  document.put("c", 1);
+  document.end_line();
+  // The style carries over to the next line until changed.
+  document.put("d", 1);
+  document.set_style(tty::Style{});
+  document.put("e", 1);
+  document.end_line();
+
+  std::vector<tty::Cell> cells;
+  document.line(0, 0, &cells);
+  ASSERT_EQ(3U, cells.size());
+  EXPECT_EQ(tty::Style{}, cells[0].style_);
+  EXPECT_EQ(make_style(1), cells[1].style_);
+  EXPECT_EQ(make_style(1), cells[2].style_);
+
+  document.line(1, 0, &cells);
+  ASSERT_EQ(2U, cells.size());
+  EXPECT_EQ(make_style(1), cells[0].style_);
+  EXPECT_EQ(tty::Style{}, cells[1].style_);
+
+  std::string output;
+  document.append_line(&output, 0);
+  EXPECT_EQ("a\033[31mbc\033[m", output);
+
+  output.clear();
+  document.append_line(&output, 1);
+  EXPECT_EQ("\033[31md\033[me", output);
+}
+
+TEST(DocumentTest, Viewport) {
+  tty::Document document;
+  for (int i = 0; i < 100; ++i) add_line(&document, std::to_string(i));
+
+  tty::Screen screen;
+  tty::viewport(&screen, document, 10, 80, 5);
+  ASSERT_EQ(5U, screen.rows_.size());
+  EXPECT_EQ("10", cells_text(screen.rows_[0]));
+  EXPECT_EQ("14", cells_text(screen.rows_[4]));
+
+  tty::viewport(&screen, document, 98, 80, 5);
+  ASSERT_EQ(2U, screen.rows_.size());
+  EXPECT_EQ("99", cells_text(screen.rows_[1]));
+}
+
+TEST(PagerTest, ScrollsAndQuits) {
+  tty::Document document;
+  for (int i = 0; i < 100; ++i)
+    add_line(&document, "line " + std::to_string(i));
+
+  int input[2], output[2];
+  ASSERT_EQ(0, pipe(input));
+  ASSERT_EQ(0, pipe(output));
+  ASSERT_EQ(0, fcntl(output[0], F_SETFL, O_NONBLOCK));
+
+  // Down, an unknown escape sequence, page down, and quit.
+  ASSERT_EQ(9, write(input[1], "j\033[15~ q", 9));
+  close(input[1]);
+
+  tty::Pager{document, input[0], output[1]}.run();
+
+  std::string data;
+  char buffer[4096];
+  ssize_t ret;
+  while (0 < (ret = read(output[0], buffer, sizeof(buffer))))
+    data.append(buffer, ret);
+
+  close(input[0]);
+  close(output[0]);
+  close(output[1]);
+
+  EXPECT_NE(std::string::npos, data.find("\033[?1049h"));
+  // Without a terminal, the pager assumes 24 lines.
+  EXPECT_NE(std::string::npos, data.find("lines 1-23 of 100"));
+  EXPECT_NE(std::string::npos, data.find("lines 2-24 of 100"));
+  EXPECT_NE(std::string::npos, data.find("lines 25-47 of 100"));
+  EXPECT_NE(std::string::npos, data.find("line 0"));
+  EXPECT_NE(std::string::npos, data.find("line 22"));
+  EXPECT_EQ("\033[?25h\033[?1049l", data.substr(data.size() - 14));
+}
+
+}  // namespace
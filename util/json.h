@@ -0,0 +1,137 @@
+#pragma once
+
+// Helpers for writing JSON.
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace json {
+
+namespace internal {
+
+// Bytes that need no escaping inside a JSON string.
+struct plain_bytes {
+  plain_bytes() {
+    for (int ch = 0x20; ch < 0x100; ++ch) plain[ch] = true;
+    plain[static_cast<unsigned char>('"')] = false;
+    plain[static_cast<unsigned char>('\\')] = false;
+    plain[0x7f] = false;
+  }
+
+  bool operator[](char ch) const {
+    return plain[static_cast<unsigned char>(ch)];
+  }
+
+  bool plain[256] = {};
+};
+
+}  // namespace internal
+
+// Appends `len` bytes at `text` to `output` as a quoted JSON string.  The
+// input must be valid UTF-8, which is copied as is.
+inline void escape(std::string* output, const char* text, size_t len) {
+  static const char hex_digits[] = "0123456789abcdef";
+  static const internal::plain_bytes plain;
+
+  const auto end = text + len;
+
+  output->reserve(output->size() + len + 2);
+  output->push_back('"');
+
+  while (text != end) {
+    auto run_end = text;
+    while (run_end != end && plain[*run_end]) ++run_end;
+    output->append(text, run_end);
+    text = run_end;
+
+    for (; text != end && !plain[*text]; ++text) {
+      output->push_back('\\');
+      switch (*text) {
+        case '"':
+          output->push_back('"');
+          break;
+        case '\\':
+          output->push_back('\\');
+          break;
+        case '\b':
+          output->push_back('b');
+          break;
+        case '\f':
+          output->push_back('f');
+          break;
+        case '\n':
+          output->push_back('n');
+          break;
+        case '\r':
+          output->push_back('r');
+          break;
+        case '\t':
+          output->push_back('t');
+          break;
+        default:
+          output->append("u00");
+          output->push_back(hex_digits[static_cast<unsigned char>(*text) >> 4]);
+          output->push_back(hex_digits[*text & 15]);
+      }
+    }
+  }
+
+  output->push_back('"');
+}
+
+inline void escape(std::string* output, const std::string& text) {
+  escape(output, text.data(), text.size());
+}
+
+// Appends a JSON object to a string, one member at a time.
+class object_writer {
+ public:
+  explicit object_writer(std::string* output) : output_{output} {
+    output_->push_back('{');
+  }
+
+  void add(const char* key, const char* value, size_t len) {
+    add_key(key);
+    escape(output_, value, len);
+  }
+
+  void add(const char* key, const std::string& value) {
+    add(key, value.data(), value.size());
+  }
+
+  void add(const char* key, const char* value) {
+    add(key, value, std::strlen(value));
+  }
+
+  void add(const char* key, bool value) {
+    add_key(key);
+    output_->append(value ? "true" : "false");
+  }
+
+  void add(const char* key, const std::vector<std::string>& values) {
+    add_key(key);
+    output_->push_back('[');
+    for (size_t i = 0; i < values.size(); ++i) {
+      if (i) output_->push_back(',');
+      escape(output_, values[i]);
+    }
+    output_->push_back(']');
+  }
+
+  // Ends the object.
+  void close() { output_->push_back('}'); }
+
+ private:
+  void add_key(const char* key) {
+    if (!first_) output_->push_back(',');
+    first_ = false;
+    escape(output_, key, std::strlen(key));
+    output_->push_back(':');
+  }
+
+  std::string* output_;
+  bool first_ = true;
+};
+
+}  // namespace json
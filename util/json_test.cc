@@ -0,0 +1,50 @@
+#include "util/json.h"
+
+#include "third_party/gtest/include/gtest/gtest.h"
+
+namespace {
+
+std::string escape(const std::string& text) {
+  std::string result;
+  json::escape(&result, text);
+  return result;
+}
+
+TEST(JsonTest, Escape) {
+  EXPECT_EQ("\"\"", escape(""));
+  EXPECT_EQ("\"abc def\"", escape("abc def"));
+  EXPECT_EQ("\"a\\\"b\\\\c\"", escape("a\"b\\c"));
+  EXPECT_EQ("\"\\b\\f\\n\\r\\t\"", escape("\b\f\n\r\t"));
+  EXPECT_EQ("\"\\u0000\\u001b[1m\\u007f\"",
+            escape(std::string{"\0\033[1m\177", 6}));
+  EXPECT_EQ("\"bl\xc3\xa5" "b\xc3\xa6r\"", escape("bl\xc3\xa5" "b\xc3\xa6r"));
+
+  std::string long_text(10000, 'x');
+  long_text[5000] = '\n';
+  EXPECT_EQ("\"" + std::string(5000, 'x') + "\\n" + std::string(4999, 'x') +
+                "\"",
+            escape(long_text));
+}
+
+TEST(JsonTest, ObjectWriter) {
+  std::string output = "prefix ";
+
+  json::object_writer writer{&output};
+  writer.add("type", "prompt");
+  writer.add("text", std::string{"Name: "});
+  writer.add("file", true);
+  writer.add("options", std::vector<std::string>{"a", "b\"c"});
+  writer.add("empty", std::vector<std::string>{});
+  writer.close();
+
+  EXPECT_EQ(
+      "prefix {\"type\":\"prompt\",\"text\":\"Name: \",\"file\":true,"
+      "\"options\":[\"a\",\"b\\\"c\"],\"empty\":[]}",
+      output);
+
+  output.clear();
+  json::object_writer{&output}.close();
+  EXPECT_EQ("{}", output);
+}
+
+}  // namespace
@@ -0,0 +1,267 @@
+#pragma once
+
+// An interactive viewer for documents longer than the terminal.
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <string>
+#include <system_error>
+
+#include <termios.h>
+#include <unistd.h>
+
+#include "util/document.h"
+#include "util/screen.h"
+#include "util/string.h"
+#include "util/tty.h"
+
+namespace tty {
+
+// Stores in `screen` the `rows` lines of `document` starting at line `top`.
+inline void viewport(Screen* screen, const Document& document, size_t top,
+                     unsigned int columns, unsigned int rows) {
+  screen->columns_ = columns;
+  screen->rows_.resize(std::min<size_t>(
+      rows, document.size() - std::min(top, document.size())));
+
+  for (size_t i = 0; i < screen->rows_.size(); ++i)
+    document.line(top + i, columns, &screen->rows_[i]);
+}
+
+namespace internal {
+
+inline volatile std::sig_atomic_t& window_changed() {
+  static volatile std::sig_atomic_t changed;
+  return changed;
+}
+
+}  // namespace internal
+
+// Shows a document on the alternate screen of a terminal, one screenful at a
+// time, until the user quits.
+//
+// Keys: q quits; j, Down and Enter scroll down a line; k and Up scroll up a
+// line; Space, f and Page Down scroll down a page; b and Page Up scroll up a
+// page; g and Home go to the top; G and End go to the bottom.
+//
+// Only the visible lines are read from the document, and only the parts of
+// the terminal that change are redrawn, so the cost of a key press does not
+// depend on the length of the document.
+class Pager {
+ public:
+  Pager(const Document& document, int input_fd, int output_fd)
+      : document_{document}, input_fd_{input_fd}, output_fd_{output_fd} {}
+
+  void run() {
+    // Use raw mode if the input is a terminal.
+    termios saved_termios;
+    const auto raw = (0 == tcgetattr(input_fd_, &saved_termios));
+    if (raw) {
+      auto termios = saved_termios;
+      termios.c_lflag &= ~(ICANON | ECHO);
+      termios.c_cc[VMIN] = 1;
+      termios.c_cc[VTIME] = 0;
+      tcsetattr(input_fd_, TCSAFLUSH, &termios);
+    }
+
+    struct sigaction action, saved_action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = [](int) { internal::window_changed() = 1; };
+    sigaction(SIGWINCH, &action, &saved_action);
+
+    // Switch to the alternate screen, and hide the cursor.
+    write("\033[?1049h\033[?25l");
+
+    try {
+      loop();
+    } catch (...) {
+      restore(raw, saved_termios, saved_action);
+      throw;
+    }
+
+    restore(raw, saved_termios, saved_action);
+  }
+
+ private:
+  enum class Key { None, Quit, Down, Up, PageDown, PageUp, Top, Bottom };
+
+  void loop() {
+    Screen previous, current;
+    std::string output;
+
+    unsigned int drawn_lines = 0;
+    size_t top = 0;
+
+    for (;;) {
+      unsigned int columns = 80, lines = 24;
+      if (!window_size(output_fd_, &columns, &lines) || !columns || !lines) {
+        columns = 80;
+        lines = 24;
+      }
+
+      // The last line of the terminal shows the status.
+      const auto rows = std::max(lines, 2u) - 1;
+      const auto max_top = document_.size() - std::min<size_t>(
+                                                  document_.size(), rows);
+      top = std::min(top, max_top);
+
+      viewport(&current, document_, top, columns, rows);
+
+      output.clear();
+      if (columns != previous.columns_ || lines != drawn_lines) {
+        output.append("\033[H\033[2J");
+        previous = Screen{};
+        drawn_lines = lines;
+      }
+
+      // `diff` expects the cursor right below the previous rows.
+      append_move(&output, previous.rows_.size());
+      diff(&output, previous, current);
+
+      append_move(&output, rows);
+      append_status(&output, top, rows, columns);
+      write(output);
+
+      std::swap(previous, current);
+
+      switch (read_key()) {
+        case Key::Quit:
+          return;
+        case Key::Down:
+          if (top < max_top) ++top;
+          break;
+        case Key::Up:
+          if (top > 0) --top;
+          break;
+        case Key::PageDown:
+          top = std::min<size_t>(top + rows, max_top);
+          break;
+        case Key::PageUp:
+          top -= std::min<size_t>(top, rows);
+          break;
+        case Key::Top:
+          top = 0;
+          break;
+        case Key::Bottom:
+          top = max_top;
+          break;
+        case Key::None:
+          break;
+      }
+    }
+  }
+
+  // Moves the cursor to the start of `row`, counting from zero.
+  static void append_move(std::string* output, size_t row) {
+    output->append(string::cat("\033[", row + 1, "H"));
+  }
+
+  void append_status(std::string* output, size_t top, unsigned int rows,
+                     unsigned int columns) const {
+    const auto last = std::min<size_t>(top + rows, document_.size());
+    auto status = string::cat(" lines ", top + 1, "-", last, " of ",
+                              document_.size(), " (",
+                              document_.size() ? 100 * last / document_.size()
+                                               : 100,
+                              "%)", (last == document_.size() ? " (END)" : ""),
+                              "  q to quit ");
+    if (status.size() > columns) status.resize(columns);
+
+    output->append("\033[K\033[7m");
+    output->append(status);
+    output->append("\033[m");
+  }
+
+  Key read_key() {
+    static const struct {
+      const char* sequence;
+      Key key;
+    } keys[] = {
+        {"q", Key::Quit},          {"Q", Key::Quit},
+        {"j", Key::Down},          {"\n", Key::Down},
+        {"\r", Key::Down},         {"\033[B", Key::Down},
+        {"\033OB", Key::Down},     {"k", Key::Up},
+        {"\033[A", Key::Up},       {"\033OA", Key::Up},
+        {" ", Key::PageDown},      {"f", Key::PageDown},
+        {"\033[6~", Key::PageDown}, {"b", Key::PageUp},
+        {"\033[5~", Key::PageUp},   {"g", Key::Top},
+        {"<", Key::Top},           {"\033[H", Key::Top},
+        {"\033[1~", Key::Top},      {"G", Key::Bottom},
+        {">", Key::Bottom},        {"\033[F", Key::Bottom},
+        {"\033[4~", Key::Bottom},
+    };
+
+    while (input_.empty()) {
+      char buffer[64];
+      const auto ret = ::read(input_fd_, buffer, sizeof(buffer));
+      if (ret == -1) {
+        if (errno != EINTR)
+          throw std::system_error{errno, std::system_category(),
+                                  "reading from terminal failed"};
+        if (internal::window_changed()) {
+          internal::window_changed() = 0;
+          return Key::None;
+        }
+        continue;
+      }
+
+      // Treat end of input like a request to quit.
+      if (ret == 0) return Key::Quit;
+
+      input_.assign(buffer, ret);
+    }
+
+    for (const auto& k : keys) {
+      if (string::starts_with(input_, k.sequence)) {
+        input_.erase(0, std::strlen(k.sequence));
+        return k.key;
+      }
+    }
+
+    // Skip unknown keys, including the rest of an escape sequence.
+    size_t length = 1;
+    if (input_[0] == '\033' && input_.size() > 1 &&
+        (input_[1] == '[' || input_[1] == 'O')) {
+      length = 2;
+      while (length < input_.size() &&
+             !(input_[length] >= 0x40 && input_[length] <= 0x7e))
+        ++length;
+      length = std::min(length + 1, input_.size());
+    }
+    input_.erase(0, length);
+
+    return Key::None;
+  }
+
+  void restore(bool raw, const termios& saved_termios,
+               const struct sigaction& saved_action) {
+    write("\033[?25h\033[?1049l");
+    sigaction(SIGWINCH, &saved_action, nullptr);
+    if (raw) tcsetattr(input_fd_, TCSANOW, &saved_termios);
+  }
+
+  void write(const std::string& data) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+      const auto ret =
+          ::write(output_fd_, data.data() + offset, data.size() - offset);
+      if (ret == -1) {
+        if (errno == EINTR) continue;
+        throw std::system_error{errno, std::system_category(),
+                                "writing to terminal failed"};
+      }
+      offset += ret;
+    }
+  }
+
+  const Document& document_;
+  const int input_fd_;
+  const int output_fd_;
+
+  // Input read from the terminal, but not yet handled.
+  std::string input_;
+};
+
+}  // namespace tty
@@ -6,7 +6,7 @@
 
 namespace path {
 
-std::string normalize(const std::string& path) {
+inline std::string normalize(const std::string& path) {
   const auto ends_with_slash = string::ends_with(path, "/");
 
   std::vector<std::string> result_parts;
@@ -0,0 +1,241 @@
+#pragma once
+
+// Records HTTP exchanges to a file, and plays them back later.
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "util/string.h"
+
+namespace recording {
+
+// Part of a response, as it arrived.
+struct chunk {
+  // True for a header line, false for body data.
+  bool header = false;
+
+  // Microseconds from the start of the request until the chunk arrived.
+  std::uint64_t offset_us = 0;
+
+  std::string data;
+
+  bool operator==(const chunk& rhs) const {
+    return header == rhs.header && offset_us == rhs.offset_us &&
+           data == rhs.data;
+  }
+};
+
+// A request and its response.
+struct exchange {
+  std::string method;
+  std::string url;
+  std::string body;
+
+  std::vector<chunk> chunks;
+
+  // Microseconds from the start of the request until the transfer completed.
+  std::uint64_t duration_us = 0;
+
+  bool operator==(const exchange& rhs) const {
+    return method == rhs.method && url == rhs.url && body == rhs.body &&
+           chunks == rhs.chunks && duration_us == rhs.duration_us;
+  }
+};
+
+// The file starts with this line, followed by the exchanges in order.  Each
+// exchange is a line "<duration> <method> <url size> <body size> <chunk
+// count>", followed by the URL and the body, and then for each chunk a line
+// "<h|d> <offset> <size>" followed by the data.
+static const char kMagic[] = "ttyml-recording 1\n";
+
+// Appends exchanges to a file.
+class writer {
+ public:
+  explicit writer(const std::string& path)
+      : path_{path}, file_{std::fopen(path.c_str(), "we")} {
+    if (!file_)
+      throw std::system_error{errno, std::system_category(),
+                              string::cat("opening ", path, " failed")};
+    put(kMagic, std::strlen(kMagic));
+  }
+
+  ~writer() { std::fclose(file_); }
+
+  writer(const writer&) = delete;
+  writer& operator=(const writer&) = delete;
+
+  // Writes `e` to the file.  The file is flushed after each exchange, so that
+  // an interrupted session leaves a usable recording.
+  void write(const exchange& e) {
+    put(string::cat(e.duration_us, ' ', e.method, ' ', e.url.size(), ' ',
+                    e.body.size(), ' ', e.chunks.size(), '\n'));
+    put(e.url);
+    put(e.body);
+
+    for (const auto& c : e.chunks) {
+      put(string::cat(c.header ? 'h' : 'd', ' ', c.offset_us, ' ',
+                      c.data.size(), '\n'));
+      put(c.data);
+    }
+
+    if (0 != std::fflush(file_))
+      throw std::system_error{errno, std::system_category(),
+                              string::cat("writing ", path_, " failed")};
+  }
+
+ private:
+  void put(const std::string& data) { put(data.data(), data.size()); }
+
+  void put(const char* data, size_t size) {
+    if (size != std::fwrite(data, 1, size, file_))
+      throw std::system_error{errno, std::system_category(),
+                              string::cat("writing ", path_, " failed")};
+  }
+
+  const std::string path_;
+  std::FILE* file_;
+};
+
+namespace internal {
+
+class parser {
+ public:
+  parser(const std::string& data, const std::string& path)
+      : p_{data.data()}, end_{data.data() + data.size()}, path_{path} {}
+
+  bool at_end() const { return p_ == end_; }
+
+  std::uint64_t number() {
+    if (p_ == end_ || *p_ < '0' || *p_ > '9') fail();
+    std::uint64_t result = 0;
+    while (p_ != end_ && *p_ >= '0' && *p_ <= '9')
+      result = result * 10 + (*p_++ - '0');
+    return result;
+  }
+
+  std::string word() {
+    const auto begin = p_;
+    while (p_ != end_ && *p_ != ' ' && *p_ != '\n') ++p_;
+    if (p_ == begin) fail();
+    return std::string{begin, p_};
+  }
+
+  std::string bytes(std::uint64_t size) {
+    if (static_cast<std::uint64_t>(end_ - p_) < size) fail();
+    std::string result{p_, static_cast<size_t>(size)};
+    p_ += size;
+    return result;
+  }
+
+  void expect(char ch) {
+    if (p_ == end_ || *p_ != ch) fail();
+    ++p_;
+  }
+
+  [[noreturn]] void fail() const {
+    throw std::runtime_error{string::cat(path_, ": malformed recording")};
+  }
+
+ private:
+  const char* p_;
+  const char* end_;
+  const std::string& path_;
+};
+
+}  // namespace internal
+
+// Reads all exchanges from the file at `path`.
+inline std::vector<exchange> load(const std::string& path) {
+  const auto file = std::fopen(path.c_str(), "re");
+  if (!file)
+    throw std::system_error{errno, std::system_category(),
+                            string::cat("opening ", path, " failed")};
+
+  std::string data;
+  char buffer[65536];
+  size_t amount;
+  while (0 < (amount = std::fread(buffer, 1, sizeof(buffer), file)))
+    data.append(buffer, amount);
+  const auto failed = std::ferror(file);
+  const auto error = errno;
+  std::fclose(file);
+  if (failed)
+    throw std::system_error{error, std::system_category(),
+                            string::cat("reading ", path, " failed")};
+
+  internal::parser parser{data, path};
+  if (parser.bytes(std::strlen(kMagic)) != kMagic) parser.fail();
+
+  std::vector<exchange> result;
+
+  while (!parser.at_end()) {
+    exchange e;
+    e.duration_us = parser.number();
+    parser.expect(' ');
+    e.method = parser.word();
+    parser.expect(' ');
+    const auto url_size = parser.number();
+    parser.expect(' ');
+    const auto body_size = parser.number();
+    parser.expect(' ');
+    const auto chunk_count = parser.number();
+    parser.expect('\n');
+    e.url = parser.bytes(url_size);
+    e.body = parser.bytes(body_size);
+
+    for (std::uint64_t i = 0; i < chunk_count; ++i) {
+      chunk c;
+      const auto kind = parser.word();
+      if (kind != "h" && kind != "d") parser.fail();
+      c.header = (kind == "h");
+      parser.expect(' ');
+      c.offset_us = parser.number();
+      parser.expect(' ');
+      const auto size = parser.number();
+      parser.expect('\n');
+      c.data = parser.bytes(size);
+      e.chunks.emplace_back(std::move(c));
+    }
+
+    result.emplace_back(std::move(e));
+  }
+
+  return result;
+}
+
+// Hands out recorded exchanges in the order they were recorded.
+class player {
+ public:
+  explicit player(std::vector<exchange> exchanges)
+      : exchanges_{std::move(exchanges)} {}
+
+  // Returns the next exchange, which must be a request for `url` with
+  // `method`.  Throws if the session has diverged from the recording.
+  const exchange& next(const std::string& method, const std::string& url) {
+    if (next_ == exchanges_.size())
+      throw std::runtime_error{
+          string::cat("recording has no more responses; requested ", method,
+                      ' ', url)};
+
+    const auto& result = exchanges_[next_];
+    if (result.method != method || result.url != url)
+      throw std::runtime_error{string::cat(
+          "session diverged from recording: requested ", method, ' ', url,
+          ", recorded ", result.method, ' ', result.url)};
+
+    ++next_;
+    return result;
+  }
+
+ private:
+  std::vector<exchange> exchanges_;
+  size_t next_ = 0;
+};
+
+}  // namespace recording
@@ -0,0 +1,53 @@
+#pragma once
+
+// Builds recorded exchanges for tests that replay pages instead of fetching
+// them.
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "util/recording.h"
+
+namespace recording {
+
+// Where test pages are served from.
+static const char kPageUrl[] = "http://localhost/page";
+
+inline chunk make_chunk(bool header, std::string data,
+                        std::uint64_t offset_us = 0) {
+  chunk result;
+  result.header = header;
+  result.offset_us = offset_us;
+  result.data = std::move(data);
+  return result;
+}
+
+// Returns a response to `method` `url` with status 200 and a text/ttyml body
+// that arrives in `chunks`.
+inline exchange make_response(const std::string& url,
+                              const std::vector<std::string>& chunks,
+                              const std::string& method = "GET") {
+  exchange result;
+  result.method = method;
+  result.url = url;
+  result.chunks.emplace_back(make_chunk(true, "HTTP/1.1 200 OK\r\n"));
+  result.chunks.emplace_back(make_chunk(true, "Content-Type: text/ttyml\r\n"));
+  result.chunks.emplace_back(make_chunk(true, "\r\n"));
+  for (const auto& c : chunks) result.chunks.emplace_back(make_chunk(false, c));
+  return result;
+}
+
+// Returns a response like the above, with `body` arriving in parts of
+// `chunk_size` bytes.
+inline exchange make_response(const std::string& url, const std::string& body,
+                              size_t chunk_size,
+                              const std::string& method = "GET") {
+  std::vector<std::string> chunks;
+  for (size_t i = 0; i < body.size(); i += chunk_size)
+    chunks.emplace_back(body.substr(i, chunk_size));
+  return make_response(url, chunks, method);
+}
+
+}  // namespace recording
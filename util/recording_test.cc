@@ -0,0 +1,103 @@
+#include "util/recording.h"
+
+#include <fstream>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "third_party/gtest/include/gtest/gtest.h"
+#include "util/recording_fixture.h"
+
+namespace {
+
+class RecordingTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    char path[] = "/tmp/recording_test.XXXXXX";
+    const auto fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    close(fd);
+    path_ = path;
+  }
+
+  void TearDown() override { unlink(path_.c_str()); }
+
+  std::string path_;
+};
+
+recording::exchange make_exchange(std::string method, std::string url) {
+  recording::exchange result;
+  result.method = std::move(method);
+  result.url = std::move(url);
+  return result;
+}
+
+TEST_F(RecordingTest, RoundTrip) {
+  std::vector<recording::exchange> exchanges;
+
+  exchanges.emplace_back(make_exchange("GET", "http://example.org/a b"));
+  exchanges.back().chunks.emplace_back(
+      recording::make_chunk(true, "HTTP/1.1 200 OK\r\n", 1500));
+  exchanges.back().chunks.emplace_back(
+      recording::make_chunk(true, "Content-Type: text/ttyml\r\n", 1501));
+  exchanges.back().chunks.emplace_back(
+      recording::make_chunk(true, "\r\n", 1502));
+  exchanges.back().chunks.emplace_back(
+      recording::make_chunk(false, std::string{"<ttyml>\n\0\n", 10}, 2000));
+  exchanges.back().duration_us = 2500;
+
+  exchanges.emplace_back(make_exchange("POST", "http://example.org/"));
+  exchanges.back().body = "a=1&b=2\n";
+
+  {
+    recording::writer writer{path_};
+    for (const auto& e : exchanges) writer.write(e);
+  }
+
+  EXPECT_EQ(exchanges, recording::load(path_));
+}
+
+TEST_F(RecordingTest, Empty) {
+  { recording::writer writer{path_}; }
+
+  EXPECT_TRUE(recording::load(path_).empty());
+}
+
+TEST_F(RecordingTest, Truncated) {
+  {
+    recording::writer writer{path_};
+    auto e = make_exchange("GET", "http://example.org/");
+    e.chunks.emplace_back(recording::make_chunk(false, "abcdef", 10));
+    writer.write(e);
+  }
+
+  struct stat st;
+  ASSERT_EQ(0, stat(path_.c_str(), &st));
+  ASSERT_EQ(0, truncate(path_.c_str(), st.st_size - 1));
+
+  EXPECT_THROW(recording::load(path_), std::runtime_error);
+}
+
+TEST_F(RecordingTest, Malformed) {
+  std::ofstream{path_} << "ttyml-recording 1\nx GET 1 0 0\n/";
+
+  EXPECT_THROW(recording::load(path_), std::runtime_error);
+}
+
+TEST(PlayerTest, Sequence) {
+  std::vector<recording::exchange> exchanges;
+  exchanges.emplace_back(make_exchange("GET", "http://example.org/"));
+  exchanges.emplace_back(make_exchange("POST", "http://example.org/submit"));
+
+  recording::player player{std::move(exchanges)};
+
+  EXPECT_EQ("http://example.org/",
+            player.next("GET", "http://example.org/").url);
+  EXPECT_THROW(player.next("GET", "http://example.org/submit"),
+               std::runtime_error);
+  EXPECT_EQ("http://example.org/submit",
+            player.next("POST", "http://example.org/submit").url);
+  EXPECT_THROW(player.next("GET", "http://example.org/"), std::runtime_error);
+}
+
+}  // namespace
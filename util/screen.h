@@ -0,0 +1,165 @@
+#pragma once
+
+// A model of the text shown on a terminal, used to redraw only the parts of
+// the screen that changed between two renders.
+
+#include <string>
+#include <vector>
+
+#include "util/tty.h"
+#include "util/utf8.h"
+
+namespace tty {
+
+struct Cell {
+  char32_t ch_ = ' ';
+  Style style_;
+
+  bool operator==(const Cell& rhs) const {
+    return ch_ == rhs.ch_ && style_ == rhs.style_;
+  }
+
+  bool operator!=(const Cell& rhs) const { return !(*this == rhs); }
+};
+
+class Screen {
+ public:
+  // Text beyond this many columns is discarded, so that no row wraps.  Zero
+  // means unlimited.
+  unsigned int columns_ = 0;
+
+  std::vector<std::vector<Cell>> rows_;
+};
+
+// Renders lines into a row of a screen.
+class ScreenWriter : public Writer {
+ public:
+  ScreenWriter(Screen& screen) : screen_{screen} {
+    screen_.rows_.emplace_back();
+  }
+
+  void put(const char* text, size_t len) final {
+    auto& row = screen_.rows_.back();
+
+    const auto end = text + len;
+    while (text != end) {
+      const auto ch = utf8::decode(&text, end);
+      const auto ch_width = utf8::width(ch);
+      if (!ch_width) continue;
+      if (screen_.columns_ && column_ + ch_width > screen_.columns_) return;
+
+      row.emplace_back();
+      row.back().ch_ = ch;
+      row.back().style_ = style_;
+      column_ += ch_width;
+    }
+  }
+
+  void transition(const Style& from, const Style& to) final { style_ = to; }
+
+ private:
+  Screen& screen_;
+
+  Style style_;
+  unsigned int column_ = 0;
+};
+
+namespace internal {
+
+inline unsigned int cells_width(std::vector<Cell>::const_iterator begin,
+                                std::vector<Cell>::const_iterator end) {
+  unsigned int result = 0;
+  for (; begin != end; ++begin) result += utf8::width(begin->ch_);
+  return result;
+}
+
+}  // namespace internal
+
+// Appends to `output` the escape sequences that change a terminal showing
+// `from` in its top left corner into one showing `to`.
+//
+// The cursor is left at the beginning of the line below the last row, with the
+// default style, which is also where it is assumed to be initially.
+inline void diff(std::string* output, const Screen& from, const Screen& to) {
+  static const std::vector<Cell> empty_row;
+
+  Style style;
+
+  // Cursor position, 0-based.
+  unsigned int cursor_row = from.rows_.size(), cursor_column = 0;
+
+  const auto move_to = [&](unsigned int row, unsigned int column) {
+    if (row == cursor_row && column == cursor_column) return;
+    output->append("\033[");
+    output->append(std::to_string(row + 1));
+    output->push_back(';');
+    output->append(std::to_string(column + 1));
+    output->push_back('H');
+    cursor_row = row;
+    cursor_column = column;
+  };
+
+  for (size_t row = 0; row < to.rows_.size(); ++row) {
+    const auto& old_cells =
+        (row < from.rows_.size()) ? from.rows_[row] : empty_row;
+    const auto& new_cells = to.rows_[row];
+
+    if (old_cells == new_cells) continue;
+
+    // Skip the common prefix.
+    auto old_begin = old_cells.begin();
+    auto new_begin = new_cells.begin();
+    while (old_begin != old_cells.end() && new_begin != new_cells.end() &&
+           *old_begin == *new_begin) {
+      ++old_begin;
+      ++new_begin;
+    }
+
+    // Skip the common suffix, provided the cells in between occupy the same
+    // number of columns in both rows.
+    auto old_end = old_cells.end();
+    auto new_end = new_cells.end();
+    while (old_end != old_begin && new_end != new_begin &&
+           old_end[-1] == new_end[-1]) {
+      --old_end;
+      --new_end;
+    }
+    if (internal::cells_width(old_begin, old_end) !=
+        internal::cells_width(new_begin, new_end)) {
+      old_end = old_cells.end();
+      new_end = new_cells.end();
+    }
+
+    const auto column = internal::cells_width(new_cells.begin(), new_begin);
+    move_to(row, column);
+
+    std::string text;
+    for (auto i = new_begin; i != new_end; ++i) {
+      append_transition(output, style, i->style_);
+      style = i->style_;
+      text.clear();
+      utf8::encode(&text, i->ch_);
+      output->append(text);
+    }
+    cursor_column = column + internal::cells_width(new_begin, new_end);
+
+    if (new_end == new_cells.end() &&
+        internal::cells_width(new_cells.begin(), new_cells.end()) <
+            internal::cells_width(old_cells.begin(), old_cells.end())) {
+      append_transition(output, style, Style{});
+      style = Style{};
+      output->append("\033[K");
+    }
+  }
+
+  append_transition(output, style, Style{});
+
+  if (from.rows_.size() > to.rows_.size()) {
+    move_to(to.rows_.size(), 0);
+    output->append("\033[J");
+  }
+
+  move_to(to.rows_.size(), 0);
+}
+
+}  // namespace tty
@@ -0,0 +1,104 @@
+#include "util/screen.h"
+
+#include "third_party/gtest/include/gtest/gtest.h"
+
+namespace {
+
+void add_line(tty::Screen* screen, const std::string& text,
+              const tty::Style& style = tty::Style{}) {
+  tty::ScreenWriter writer{*screen};
+  writer.transition(tty::Style{}, style);
+  writer.put(text.data(), text.size());
+  writer.transition(style, tty::Style{});
+}
+
+std::string diff(const tty::Screen& from, const tty::Screen& to) {
+  std::string result;
+  tty::diff(&result, from, to);
+  return result;
+}
+
+TEST(ScreenTest, Initial) {
+  tty::Screen screen;
+  add_line(&screen, "abc");
+  add_line(&screen, "def");
+
+  EXPECT_EQ("abc\033[2;1Hdef\033[3;1H", diff(tty::Screen{}, screen));
+}
+
+TEST(ScreenTest, Unchanged) {
+  tty::Screen screen;
+  add_line(&screen, "abc");
+  add_line(&screen, "def");
+
+  EXPECT_EQ("", diff(screen, screen));
+}
+
+TEST(ScreenTest, ChangedCells) {
+  tty::Screen from, to;
+  add_line(&from, "load: 0.15 ok");
+  add_line(&from, "unchanged");
+  add_line(&to, "load: 0.42 ok");
+  add_line(&to, "unchanged");
+
+  EXPECT_EQ("\033[1;9H42\033[3;1H", diff(from, to));
+}
+
+TEST(ScreenTest, Styles) {
+  tty::Style red;
+  red.fg_ = 1;
+
+  tty::Screen from, to;
+  add_line(&from, "status");
+  add_line(&to, "status", red);
+
+  EXPECT_EQ("\033[1;1H\033[31mstatus\033[m\033[2;1H", diff(from, to));
+}
+
+TEST(ScreenTest, ShorterRows) {
+  tty::Screen from, to;
+  add_line(&from, "abcdef");
+  add_line(&from, "ghi");
+  add_line(&to, "abc");
+
+  EXPECT_EQ("\033[1;4H\033[K\033[2;1H\033[J", diff(from, to));
+}
+
+TEST(ScreenTest, WideCharacters) {
+  tty::Screen from, to;
+  add_line(&from, "\xe6\x97\xa5x");
+  add_line(&to, "\xe6\x97\xa5y");
+
+  EXPECT_EQ("\033[1;3Hy\033[2;1H", diff(from, to));
+}
+
+TEST(ScreenTest, Truncate) {
+  tty::Screen screen;
+  screen.columns_ = 4;
+  add_line(&screen, "abc\xe6\x97\xa5");
+  add_line(&screen, "abcdef");
+
+  ASSERT_EQ(2U, screen.rows_.size());
+  EXPECT_EQ(3U, screen.rows_[0].size());
+  EXPECT_EQ(4U, screen.rows_[1].size());
+}
+
+// A dashboard where a few values change between refreshes should cost a small
+// fraction of a full redraw.
+TEST(ScreenTest, Dashboard) {
+  tty::Screen from, to;
+  for (int i = 0; i < 200; ++i) {
+    add_line(&from, "service-" + std::to_string(i) +
+                        "  requests/s: 1234  errors: 0  p99: 45ms");
+    add_line(&to, "service-" + std::to_string(i) +
+                      "  requests/s: 1234  errors: 0  p99: " +
+                      ((i % 10) ? "45" : "52") + "ms");
+  }
+
+  const auto full = diff(tty::Screen{}, to).size();
+  const auto incremental = diff(from, to).size();
+
+  EXPECT_LT(incremental * 10, full);
+}
+
+}  // namespace
@@ -5,15 +5,24 @@
 
 namespace string {
 
-char ascii_tolower(char ch) {
+inline char ascii_tolower(char ch) {
   if (ch >= 'A' && ch <= 'Z') return ch + 'a' - 'A';
   return ch;
 }
 
-void ascii_tolower(std::string* s) {
+inline void ascii_tolower(std::string* s) {
   for (auto& ch : *s) ch = ascii_tolower(ch);
 }
 
+inline char ascii_toupper(char ch) {
+  if (ch >= 'a' && ch <= 'z') return ch + 'A' - 'a';
+  return ch;
+}
+
+inline void ascii_toupper(std::string* s) {
+  for (auto& ch : *s) ch = ascii_toupper(ch);
+}
+
 template <typename T>
 void cat_to(std::ostream* output, const T& t) {
   *output << t;
@@ -71,27 +80,31 @@ std::string join(const Container& parts, char delimiter) {
   return result;
 }
 
-bool starts_with(const std::string& haystack, const std::string& needle) {
+inline bool starts_with(const std::string& haystack,
+                        const std::string& needle) {
   if (needle.size() > haystack.size()) return false;
   return 0 == haystack.compare(0, needle.size(), needle);
 }
 
-bool ends_with(const std::string& haystack, const std::string& needle) {
+inline bool ends_with(const std::string& haystack,
+                      const std::string& needle) {
   if (needle.size() > haystack.size()) return false;
   return 0 == haystack.compare(haystack.size() - needle.size(), needle.size(), needle);
 }
 
-void strip_left(std::string* s) {
+inline void strip_left(std::string* s) {
   std::string::size_type i = 0;
-  while (i != s->size() && std::isspace(i)) ++i;
+  while (i != s->size() && std::isspace(static_cast<unsigned char>((*s)[i])))
+    ++i;
   if (i > 0) s->erase(0, i);
 }
 
-void strip_right(std::string* s) {
-  while (!s->empty() && std::isspace(s->back())) s->pop_back();
+inline void strip_right(std::string* s) {
+  while (!s->empty() && std::isspace(static_cast<unsigned char>(s->back())))
+    s->pop_back();
 }
 
-void strip(std::string* s) {
+inline void strip(std::string* s) {
   strip_left(s);
   strip_right(s);
 }
@@ -0,0 +1,33 @@
+#include "util/string.h"
+
+#include "third_party/gtest/include/gtest/gtest.h"
+
+namespace {
+
+std::string strip_left(std::string s) {
+  string::strip_left(&s);
+  return s;
+}
+
+std::string strip_right(std::string s) {
+  string::strip_right(&s);
+  return s;
+}
+
+std::string strip(std::string s) {
+  string::strip(&s);
+  return s;
+}
+
+TEST(StringTest, Strip) {
+  EXPECT_EQ("a b \n", strip_left(" \t\r\na b \n"));
+  EXPECT_EQ(" \na b", strip_right(" \na b \t\r\n"));
+  EXPECT_EQ("a b", strip(" \t a b\n"));
+  EXPECT_EQ("", strip(" \n "));
+  EXPECT_EQ("", strip(""));
+
+  // Bytes of UTF-8 sequences are not white space.
+  EXPECT_EQ("\xc2\xa0x\xc2\x85", strip(" \xc2\xa0x\xc2\x85 "));
+}
+
+}  // namespace
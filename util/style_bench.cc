@@ -0,0 +1,177 @@
+// Compares applying styles as soon as a <style> element opens or closes with
+// applying them only when text is written, on lines styled word by word, as
+// generated pages often are.  Reports the bytes written per line, and the
+// time to render and write them to /dev/null.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+
+#include "util/bench.h"
+#include "util/tty.h"
+
+namespace {
+
+// One event of a line: a style opening, a style closing, or text.
+struct Event {
+  enum class Type { Open, Close, Text } type;
+  tty::Style style;
+  std::string text;
+};
+
+tty::Style make_style(unsigned int fg, bool bold = false) {
+  tty::Style result;
+  result.fg_ = fg;
+  result.bold_ = bold;
+  return result;
+}
+
+// Writes styled text to a buffer, as for a terminal, counting bytes.
+class TerminalWriter : public tty::Writer {
+ public:
+  TerminalWriter(tty::OutputBuffer& output, size_t& bytes)
+      : output_{output}, bytes_{bytes} {}
+
+  void put(const char* text, size_t len) final {
+    output_.append(text, len);
+    bytes_ += len;
+  }
+
+  void transition(const tty::Style& from, const tty::Style& to) final {
+    buffer_.clear();
+    tty::append_transition(&buffer_, from, to);
+    put(buffer_.data(), buffer_.size());
+  }
+
+  void end_line() final { put("\n", 1); }
+
+ private:
+  tty::OutputBuffer& output_;
+  size_t& bytes_;
+  std::string buffer_;
+};
+
+// Makes a transition for every opening and closing element.
+void render_eager(const std::vector<Event>& line, tty::Writer& writer) {
+  auto& styles = writer.style_stack_;
+  for (const auto& event : line) {
+    switch (event.type) {
+      case Event::Type::Open:
+        writer.transition(styles.back(), event.style);
+        styles.emplace_back(event.style);
+        break;
+      case Event::Type::Close:
+        writer.transition(styles.back(), styles[styles.size() - 2]);
+        styles.pop_back();
+        break;
+      case Event::Type::Text:
+        writer.put(event.text.data(), event.text.size());
+        break;
+    }
+  }
+  writer.end_line();
+}
+
+// Makes transitions only as text is written, as ttyml::Context does.
+void render_lazy(const std::vector<Event>& line, tty::Writer& writer) {
+  auto& styles = writer.style_stack_;
+  for (const auto& event : line) {
+    switch (event.type) {
+      case Event::Type::Open:
+        writer.set_style(event.style);
+        styles.emplace_back(event.style);
+        break;
+      case Event::Type::Close:
+        styles.pop_back();
+        writer.set_style(styles.back());
+        break;
+      case Event::Type::Text:
+        writer.write(event.text.data(), event.text.size());
+        break;
+    }
+  }
+  writer.apply_style();
+  writer.end_line();
+}
+
+void run(const char* name, const std::vector<Event>& line) {
+  static const size_t kLines = 1000;
+
+  tty::OutputBuffer output{open("/dev/null", O_WRONLY | O_CLOEXEC)};
+
+  size_t eager_bytes = 0, lazy_bytes = 0;
+  TerminalWriter eager_writer{output, eager_bytes};
+  TerminalWriter lazy_writer{output, lazy_bytes};
+
+  render_eager(line, eager_writer);
+  render_lazy(line, lazy_writer);
+  std::printf("%s: %zu -> %zu bytes/line (%.0f%% fewer)\n", name,
+              eager_bytes, lazy_bytes,
+              100 * (1 - static_cast<double>(lazy_bytes) / eager_bytes));
+
+  const auto eager = bench::run(
+      "  eager",
+      [&] {
+        for (size_t i = 0; i < kLines; ++i) render_eager(line, eager_writer);
+        output.flush();
+      },
+      kLines);
+  const auto lazy = bench::run(
+      "  lazy",
+      [&] {
+        for (size_t i = 0; i < kLines; ++i) render_lazy(line, lazy_writer);
+        output.flush();
+      },
+      kLines);
+  std::printf("%-32s %12.2fx time\n", "", lazy.ns_per_op / eager.ns_per_op);
+}
+
+}  // namespace
+
+int main() {
+  static const char* const kWords[] = {"The ",    "quick ", "brown ",
+                                       "fox ",    "jumps ", "over ",
+                                       "the ",    "lazy ",  "dog. "};
+
+  // Every word in a style of its own, all the same.
+  std::vector<Event> same;
+  for (int i = 0; i < 4; ++i) {
+    for (const auto word : kWords) {
+      same.push_back({Event::Type::Open, make_style(2), ""});
+      same.push_back({Event::Type::Text, {}, word});
+      same.push_back({Event::Type::Close, {}, ""});
+    }
+  }
+  run("same style per word", same);
+
+  // Syntax highlighting, with runs of equal styles and empty elements.
+  std::vector<Event> highlighted;
+  for (int i = 0; i < 4; ++i) {
+    unsigned int fg = 1;
+    for (const auto word : kWords) {
+      const auto color = fg / 3 + 1;
+      highlighted.push_back({Event::Type::Open, make_style(color), ""});
+      highlighted.push_back(
+          {Event::Type::Open, make_style(color, fg % 2), ""});
+      highlighted.push_back({Event::Type::Close, {}, ""});
+      highlighted.push_back({Event::Type::Text, {}, word});
+      highlighted.push_back({Event::Type::Close, {}, ""});
+      ++fg;
+    }
+  }
+  run("highlighted", highlighted);
+
+  // A different style for every word, where nothing can be saved.
+  std::vector<Event> different;
+  for (int i = 0; i < 4; ++i) {
+    unsigned int fg = 1;
+    for (const auto word : kWords) {
+      different.push_back({Event::Type::Open, make_style(fg++ % 7 + 1), ""});
+      different.push_back({Event::Type::Text, {}, word});
+      different.push_back({Event::Type::Close, {}, ""});
+    }
+  }
+  run("different style per word", different);
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+// Aligns rows of cells into columns while streaming, holding at most a fixed
+// number of rows in memory.
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "util/screen.h"
+#include "util/tty.h"
+#include "util/utf8.h"
+
+namespace tty {
+
+// Renders text into the cells of a table cell.
+class CellWriter : public Writer {
+ public:
+  CellWriter(std::vector<Cell>& cells) : cells_{cells} {}
+
+  void put(const char* text, size_t len) final {
+    const auto end = text + len;
+    while (text != end) {
+      const auto ch = utf8::decode(&text, end);
+      if (!utf8::width(ch)) continue;
+
+      cells_.emplace_back();
+      cells_.back().ch_ = ch;
+      cells_.back().style_ = style_;
+    }
+  }
+
+  void transition(const Style& from, const Style& to) final { style_ = to; }
+
+ private:
+  std::vector<Cell>& cells_;
+
+  Style style_;
+};
+
+class Table {
+ public:
+  using Row = std::vector<std::vector<Cell>>;
+
+  // Rows are written as lines through writers returned by `make_writer`.
+  //
+  // `widths` holds the widths of the leading columns; a width of zero means
+  // the column is as wide as its widest cell among the first `window` rows,
+  // as are any columns beyond those in `widths`.  Rows are held back until
+  // the widths are known.  If `widths` is non-empty and has no zeros, rows are
+  // written as soon as they arrive, and any extra columns are as wide as their
+  // content.  Cells wider than their column are truncated.
+  Table(std::function<std::unique_ptr<Writer>()> make_writer,
+        std::vector<unsigned int> widths, size_t window)
+      : make_writer_{std::move(make_writer)},
+        widths_{std::move(widths)},
+        window_{std::max<size_t>(window, 1)},
+        settled_{!widths_.empty() &&
+                 std::find(widths_.begin(), widths_.end(), 0u) ==
+                     widths_.end()} {}
+
+  // Adds a row to the end of the table.
+  void add_row(Row row) {
+    if (settled_) {
+      write(row);
+      return;
+    }
+
+    pending_.emplace_back(std::move(row));
+    if (pending_.size() >= window_) flush();
+  }
+
+  // Writes any rows held back.  Must be called after the last row.
+  void finish() { flush(); }
+
+ private:
+  static unsigned int cells_width(const std::vector<Cell>& cells) {
+    unsigned int result = 0;
+    for (const auto& cell : cells) result += utf8::width(cell.ch_);
+    return result;
+  }
+
+  // Settles the widths of the columns, and writes all pending rows.
+  void flush() {
+    if (!settled_) {
+      std::vector<bool> measured(widths_.size());
+      for (size_t i = 0; i < widths_.size(); ++i) measured[i] = !widths_[i];
+
+      for (const auto& row : pending_) {
+        if (row.size() > widths_.size()) {
+          widths_.resize(row.size(), 0);
+          measured.resize(row.size(), true);
+        }
+
+        for (size_t i = 0; i < row.size(); ++i) {
+          if (measured[i])
+            widths_[i] = std::max(widths_[i], cells_width(row[i]));
+        }
+      }
+
+      settled_ = true;
+    }
+
+    while (!pending_.empty()) {
+      write(pending_.front());
+      pending_.pop_front();
+    }
+  }
+
+  void write(const Row& row) {
+    const auto writer = make_writer_();
+
+    // Text not yet written, all in `style`.
+    Style style;
+    std::string text;
+
+    const auto set_style = [&](const Style& to) {
+      if (to == style) return;
+      put(writer.get(), &text);
+      writer->set_style(to);
+      style = to;
+    };
+
+    for (size_t i = 0; i < row.size(); ++i) {
+      // Columns not seen while measuring are as wide as their content.
+      const auto width =
+          (i < widths_.size()) ? widths_[i] : cells_width(row[i]);
+      const auto last = (i + 1 == row.size());
+
+      if (i > 0) text.push_back(' ');
+
+      unsigned int column = 0;
+      for (const auto& cell : row[i]) {
+        const auto ch_width = utf8::width(cell.ch_);
+        if (column + ch_width > width) break;
+
+        set_style(cell.style_);
+        utf8::encode(&text, cell.ch_);
+        column += ch_width;
+      }
+
+      // Padding and the space between columns are unstyled.
+      if (!last) {
+        set_style(Style{});
+        text.append(width - column, ' ');
+      }
+    }
+
+    set_style(Style{});
+    put(writer.get(), &text);
+    writer->apply_style();
+    writer->end_line();
+  }
+
+  static void put(Writer* writer, std::string* text) {
+    if (text->empty()) return;
+    writer->write(text->data(), text->size());
+    text->clear();
+  }
+
+  std::function<std::unique_ptr<Writer>()> make_writer_;
+
+  std::vector<unsigned int> widths_;
+  const size_t window_;
+
+  // True once the width of every column is known.
+  bool settled_;
+
+  std::deque<Row> pending_;
+};
+
+}  // namespace tty
@@ -0,0 +1,161 @@
+#include "util/table.h"
+
+#include "third_party/gtest/include/gtest/gtest.h"
+
+namespace {
+
+// Collects written lines, marking style changes with '|'.
+class LineWriter : public tty::Writer {
+ public:
+  LineWriter(std::vector<std::string>& lines) : lines_{lines} {}
+
+  void put(const char* text, size_t len) final { line_.append(text, len); }
+
+  void transition(const tty::Style& from, const tty::Style& to) final {
+    line_.push_back('|');
+  }
+
+  void end_line() final { lines_.emplace_back(std::move(line_)); }
+
+ private:
+  std::vector<std::string>& lines_;
+  std::string line_;
+};
+
+class TableTest : public testing::Test {
+ protected:
+  std::unique_ptr<tty::Table> make_table(std::vector<unsigned int> widths,
+                                         size_t window) {
+    return std::make_unique<tty::Table>(
+        [this] { return std::make_unique<LineWriter>(lines_); },
+        std::move(widths), window);
+  }
+
+  static tty::Table::Row make_row(std::vector<std::string> cells) {
+    tty::Table::Row result;
+    for (const auto& text : cells) {
+      result.emplace_back();
+      tty::CellWriter writer{result.back()};
+      writer.put(text.data(), text.size());
+    }
+    return result;
+  }
+
+  std::vector<std::string> lines_;
+};
+
+TEST_F(TableTest, MeasuresWindow) {
+  auto table = make_table({}, 10);
+
+  table->add_row(make_row({"a", "bb", "c"}));
+  table->add_row(make_row({"dddd", "e", "ffffff"}));
+  EXPECT_TRUE(lines_.empty());
+
+  table->finish();
+
+  ASSERT_EQ(2U, lines_.size());
+  EXPECT_EQ("a    bb c", lines_[0]);
+  EXPECT_EQ("dddd e  ffffff", lines_[1]);
+}
+
+TEST_F(TableTest, BoundedWindow) {
+  auto table = make_table({}, 2);
+
+  table->add_row(make_row({"a", "b"}));
+  EXPECT_TRUE(lines_.empty());
+  table->add_row(make_row({"aa", "b"}));
+  EXPECT_EQ(2U, lines_.size());
+
+  // Later rows are written immediately, truncated to the measured widths.
+  table->add_row(make_row({"aaaa", "b"}));
+  EXPECT_EQ(3U, lines_.size());
+  table->finish();
+
+  EXPECT_EQ("a  b", lines_[0]);
+  EXPECT_EQ("aa b", lines_[1]);
+  EXPECT_EQ("aa b", lines_[2]);
+}
+
+TEST_F(TableTest, DeclaredWidths) {
+  auto table = make_table({3, 2}, 100);
+
+  table->add_row(make_row({"abcdef", "g", "extra"}));
+  ASSERT_EQ(1U, lines_.size());
+  EXPECT_EQ("abc g  extra", lines_[0]);
+
+  table->finish();
+  EXPECT_EQ(1U, lines_.size());
+}
+
+TEST_F(TableTest, MixedWidths) {
+  auto table = make_table({4, 0}, 100);
+
+  table->add_row(make_row({"a", "bbb", "c"}));
+  table->add_row(make_row({"d", "e", "f"}));
+  table->finish();
+
+  ASSERT_EQ(2U, lines_.size());
+  EXPECT_EQ("a    bbb c", lines_[0]);
+  EXPECT_EQ("d    e   f", lines_[1]);
+}
+
+TEST_F(TableTest, WideCharacters) {
+  auto table = make_table({}, 10);
+
+  // U+6F22 and U+5B57 are two columns wide each.
+  table->add_row(make_row({"\xe6\xbc\xa2\xe5\xad\x97", "x"}));
+  table->add_row(make_row({"abc", "y"}));
+  table->finish();
+
+  ASSERT_EQ(2U, lines_.size());
+  EXPECT_EQ("\xe6\xbc\xa2\xe5\xad\x97 x", lines_[0]);
+  EXPECT_EQ("abc  y", lines_[1]);
+
+  // A wide character that does not fit is dropped, and replaced by padding.
+  lines_.clear();
+  table = make_table({3, 1}, 10);
+  table->add_row(make_row({"\xe6\xbc\xa2\xe5\xad\x97", "x"}));
+  ASSERT_EQ(1U, lines_.size());
+  EXPECT_EQ("\xe6\xbc\xa2  x", lines_[0]);
+}
+
+TEST_F(TableTest, Styles) {
+  auto table = make_table({2, 1}, 10);
+
+  tty::Table::Row row(2);
+  tty::CellWriter writer{row[0]};
+  tty::Style bold;
+  bold.bold_ = true;
+  writer.transition(tty::Style{}, bold);
+  writer.put("ab", 2);
+  row[1].emplace_back();
+  row[1].back().ch_ = 'c';
+
+  table->add_row(std::move(row));
+
+  // Padding is unstyled.
+  ASSERT_EQ(1U, lines_.size());
+  EXPECT_EQ("|ab| c", lines_[0]);
+}
+
+TEST_F(TableTest, StyledLastCell) {
+  auto table = make_table({1, 2}, 10);
+
+  tty::Style bold;
+  bold.bold_ = true;
+  tty::Table::Row row(2);
+  for (auto& cell : row) {
+    tty::CellWriter writer{cell};
+    writer.transition(tty::Style{}, bold);
+    writer.put("ab", 2);
+  }
+
+  table->add_row(std::move(row));
+
+  // The truncated cell has no padding to reset the style before, but the
+  // space between the columns does, and so does the end of the line.
+  ASSERT_EQ(1U, lines_.size());
+  EXPECT_EQ("|a| |ab|", lines_[0]);
+}
+
+}  // namespace
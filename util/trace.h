@@ -0,0 +1,220 @@
+#pragma once
+
+// Scoped spans and counters, written as Chrome trace events that can be
+// opened in Perfetto or chrome://tracing.
+//
+// The TRACE_ macros compile to nothing unless ENABLE_TRACE is defined, which
+// `./configure --enable-trace` does.  When compiled in, they cost one branch
+// until a recorder is installed with `trace::current() = &recorder`.
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "util/json.h"
+#include "util/string.h"
+
+namespace trace {
+
+using clock = std::chrono::steady_clock;
+
+// Writes events to a file in the JSON array format of the trace event
+// specification.  The closing bracket is optional in that format, so an
+// interrupted program still leaves a usable trace.
+class recorder {
+ public:
+  explicit recorder(const std::string& path)
+      : path_{path},
+        file_{std::fopen(path.c_str(), "we")},
+        epoch_{clock::now()} {
+    if (!file_)
+      throw std::system_error{errno, std::system_category(),
+                              string::cat("opening ", path, " failed")};
+    buffer_ = "[\n";
+  }
+
+  ~recorder() {
+    try {
+      close();
+    } catch (...) {
+    }
+  }
+
+  recorder(const recorder&) = delete;
+  recorder& operator=(const recorder&) = delete;
+
+  // Records a span from `start` to `end` on the calling thread.
+  void complete(const char* name, clock::time_point start,
+                clock::time_point end) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    begin_event(name, "X", start);
+    append_microseconds(",\"dur\":", end - start);
+    buffer_.push_back('}');
+    flush_if_full();
+  }
+
+  // Adds `delta` to the counter `name`, which must be a string literal or
+  // otherwise outlive the recorder.
+  void count(const char* name, std::int64_t delta) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    for (auto& counter : counters_) {
+      if (0 == std::strcmp(counter.first, name)) {
+        counter.second += delta;
+        return;
+      }
+    }
+    counters_.emplace_back(name, delta);
+  }
+
+  // Records the current value of every counter.
+  void write_counters() {
+    const auto now = clock::now();
+    std::lock_guard<std::mutex> lock{mutex_};
+    for (const auto& counter : counters_) {
+      begin_event(counter.first, "C", now);
+      buffer_.append(",\"args\":{\"value\":");
+      buffer_.append(std::to_string(counter.second));
+      buffer_.append("}}");
+    }
+    flush_if_full();
+  }
+
+  // Ends the trace, and throws if any of it could not be written.
+  void close() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (!file_) return;
+
+    buffer_.append("\n]\n");
+    write();
+
+    const auto failed = (0 != std::fclose(file_)) || error_;
+    file_ = nullptr;
+    if (failed)
+      throw std::system_error{error_ ? error_ : errno, std::system_category(),
+                              string::cat("writing ", path_, " failed")};
+  }
+
+ private:
+  enum : size_t { kBufferSize = 65536 };
+
+  // Returns a small number identifying the calling thread.
+  static unsigned int thread_id() {
+    static std::atomic<unsigned int> next_id{1};
+    thread_local const unsigned int id = next_id++;
+    return id;
+  }
+
+  void begin_event(const char* name, const char* phase,
+                   clock::time_point time) {
+    if (!first_) buffer_.append(",\n");
+    first_ = false;
+
+    buffer_.append("{\"name\":");
+    json::escape(&buffer_, name, std::strlen(name));
+    buffer_.append(",\"ph\":\"");
+    buffer_.append(phase);
+    buffer_.append("\",\"pid\":1,\"tid\":");
+    buffer_.append(std::to_string(thread_id()));
+    append_microseconds(",\"ts\":", time - epoch_);
+  }
+
+  void append_microseconds(const char* key, clock::duration duration) {
+    char number[32];
+    std::snprintf(
+        number, sizeof(number), "%.3f",
+        std::chrono::duration<double, std::micro>(duration).count());
+    buffer_.append(key);
+    buffer_.append(number);
+  }
+
+  void flush_if_full() {
+    if (buffer_.size() >= kBufferSize) write();
+  }
+
+  // Errors are remembered rather than thrown, since spans end in destructors.
+  void write() {
+    if (!error_ && buffer_.size() != std::fwrite(buffer_.data(), 1,
+                                                 buffer_.size(), file_))
+      error_ = errno ? errno : EIO;
+    buffer_.clear();
+  }
+
+  const std::string path_;
+  std::FILE* file_;
+  const clock::time_point epoch_;
+
+  std::mutex mutex_;
+  std::string buffer_;
+  bool first_ = true;
+  int error_ = 0;
+
+  std::vector<std::pair<const char*, std::int64_t>> counters_;
+};
+
+// The recorder receiving events, if any.
+inline recorder*& current() {
+  static recorder* result;
+  return result;
+}
+
+// Records the time from construction to destruction, if a recorder is
+// installed.
+class span {
+ public:
+  explicit span(const char* name) : recorder_{current()}, name_{name} {
+    if (recorder_) start_ = clock::now();
+  }
+
+  ~span() {
+    if (recorder_) recorder_->complete(name_, start_, clock::now());
+  }
+
+  span(const span&) = delete;
+  span& operator=(const span&) = delete;
+
+ private:
+  recorder* const recorder_;
+  const char* const name_;
+  clock::time_point start_;
+};
+
+}  // namespace trace
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef ENABLE_TRACE
+
+// Records a span covering the rest of the enclosing scope.
+#define TRACE_SPAN(name) \
+  ::trace::span TRACE_CONCAT(trace_span_, __LINE__) { name }
+
+// Adds `delta` to a counter.
+#define TRACE_COUNT(name, delta)                                     \
+  do {                                                               \
+    if (const auto trace_recorder = ::trace::current())              \
+      trace_recorder->count(name, static_cast<std::int64_t>(delta)); \
+  } while (0)
+
+// Records the current value of every counter.
+#define TRACE_WRITE_COUNTERS()                          \
+  do {                                                  \
+    if (const auto trace_recorder = ::trace::current()) \
+      trace_recorder->write_counters();                 \
+  } while (0)
+
+#else
+
+#define TRACE_SPAN(name) static_cast<void>(0)
+#define TRACE_COUNT(name, delta) static_cast<void>(0)
+#define TRACE_WRITE_COUNTERS() static_cast<void>(0)
+
+#endif
@@ -0,0 +1,124 @@
+// Exercise the macros as in a build configured with --enable-trace.
+#define ENABLE_TRACE 1
+
+#include "util/trace.h"
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <unistd.h>
+
+#include "third_party/gtest/include/gtest/gtest.h"
+
+namespace {
+
+class TraceTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    char path[] = "/tmp/trace_test.XXXXXX";
+    const auto fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    close(fd);
+    path_ = path;
+  }
+
+  void TearDown() override {
+    trace::current() = nullptr;
+    unlink(path_.c_str());
+  }
+
+  std::string read_trace() {
+    std::ifstream input{path_};
+    std::stringstream result;
+    result << input.rdbuf();
+    return result.str();
+  }
+
+  static size_t count(const std::string& haystack, const std::string& needle) {
+    size_t result = 0;
+    for (auto i = haystack.find(needle); i != std::string::npos;
+         i = haystack.find(needle, i + 1))
+      ++result;
+    return result;
+  }
+
+  // Returns the thread ID of the first event named `name`.
+  static std::string thread_of(const std::string& data,
+                               const std::string& name) {
+    const auto event = data.find("{\"name\":\"" + name + "\"");
+    if (event == std::string::npos) return "";
+    const auto tid = data.find("\"tid\":", event);
+    return data.substr(tid, data.find(',', tid) - tid);
+  }
+
+  std::string path_;
+};
+
+TEST_F(TraceTest, SpansAndCounters) {
+  {
+    trace::recorder recorder{path_};
+    trace::current() = &recorder;
+
+    {
+      TRACE_SPAN("outer");
+      TRACE_SPAN("inner \"quoted\"");
+      TRACE_COUNT("elements", 2);
+      TRACE_COUNT("elements", 3);
+      TRACE_COUNT("bytes", 100);
+    }
+    TRACE_WRITE_COUNTERS();
+
+    std::thread{[] { TRACE_SPAN("other thread"); }}.join();
+
+    trace::current() = nullptr;
+    recorder.close();
+  }
+
+  const auto data = read_trace();
+  EXPECT_EQ("[\n", data.substr(0, 2));
+  EXPECT_EQ("\n]\n", data.substr(data.size() - 3));
+
+  EXPECT_EQ(3U, count(data, "\"ph\":\"X\""));
+  EXPECT_EQ(2U, count(data, "\"ph\":\"C\""));
+  EXPECT_EQ(1U, count(data, "{\"name\":\"outer\",\"ph\":\"X\",\"pid\":1,"));
+  EXPECT_EQ(1U, count(data, "{\"name\":\"inner \\\"quoted\\\"\""));
+  EXPECT_EQ(1U, count(data, "\"name\":\"elements\""));
+  EXPECT_EQ(1U, count(data, "\"args\":{\"value\":5}"));
+  EXPECT_EQ(1U, count(data, "\"args\":{\"value\":100}"));
+
+  // The inner span ends first, and each thread has its own ID.
+  EXPECT_LT(data.find("inner"), data.find("outer"));
+  EXPECT_EQ(thread_of(data, "outer"), thread_of(data, "elements"));
+  EXPECT_NE(thread_of(data, "outer"), thread_of(data, "other thread"));
+}
+
+TEST_F(TraceTest, NothingWithoutRecorder) {
+  trace::recorder recorder{path_};
+
+  {
+    TRACE_SPAN("ignored");
+    TRACE_COUNT("ignored", 1);
+  }
+  TRACE_WRITE_COUNTERS();
+
+  recorder.close();
+
+  EXPECT_EQ("[\n\n]\n", read_trace());
+}
+
+TEST_F(TraceTest, ManyEvents) {
+  trace::recorder recorder{path_};
+  trace::current() = &recorder;
+
+  for (int i = 0; i < 10000; ++i) {
+    TRACE_SPAN("span");
+  }
+
+  trace::current() = nullptr;
+  recorder.close();
+
+  EXPECT_EQ(10000U, count(read_trace(), "\"name\":\"span\""));
+}
+
+}  // namespace
@@ -1,7 +1,20 @@
 #pragma once
 
 #include <cassert>
+#include <cerrno>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h>
+#endif
+
+#include <unistd.h>
+
+#include "util/json.h"
 
 namespace tty {
 
@@ -19,6 +32,53 @@ struct Style {
   }
 };
 
+// Appends the escape sequence that changes the terminal style from `from` to
+// `to`.
+inline void append_transition(std::string* output, const Style& from,
+                              const Style& to) {
+  if (from == to) return;
+
+  bool first = true;
+
+  output->append("\033[");
+
+  if (to != Style{}) {
+    if (from.bold_ != to.bold_) {
+      output->append(to.bold_ ? "1" : "22");
+      first = false;
+    }
+
+    if (from.fg_ != to.fg_ && to.fg_ <= 9) {
+      if (!first) output->push_back(';');
+      output->append(std::to_string(30 + to.fg_));
+      first = false;
+    }
+
+    if (from.bg_ != to.bg_ && to.bg_ <= 9) {
+      if (!first) output->push_back(';');
+      output->append(std::to_string(40 + to.bg_));
+      first = false;
+    }
+  }
+
+  output->push_back('m');
+}
+
+// Stores the size of the terminal connected to `fd` in `columns` and `lines`.
+// Returns false if the size is unknown.
+inline bool window_size(int fd, unsigned int* columns, unsigned int* lines) {
+#ifdef HAVE_SYS_IOCTL_H
+  winsize fd_winsize;
+  std::memset(&fd_winsize, 0, sizeof(fd_winsize));
+  if (-1 == ioctl(fd, TIOCGWINSZ, &fd_winsize)) return false;
+  *columns = fd_winsize.ws_col;
+  *lines = fd_winsize.ws_row;
+  return true;
+#else
+  return false;
+#endif
+}
+
 class Writer {
  public:
   Writer() { style_stack_.emplace_back(); }
@@ -29,7 +89,37 @@ class Writer {
 
   virtual void transition(const Style& from, const Style& to) = 0;
 
+  // Called when the line this writer produces is complete.
+  virtual void end_line() {}
+
+  // Makes `style` apply to text written from now on with `write`.  The
+  // transition is only made once such text arrives, so styles that hold no
+  // text, and changes that are undone before the next text, produce nothing,
+  // and adjacent runs of the same style are merged.
+  void set_style(const Style& style) { pending_style_ = style; }
+
+  // Writes text in the style last set.
+  void write(const char* text, size_t len) {
+    apply_style();
+    put(text, len);
+  }
+
+  // Returns true if the next text written needs a transition first.
+  bool style_pending() const { return pending_style_ != applied_style_; }
+
+  // Makes any transition still pending, such as back to the default style
+  // before the end of a line.
+  void apply_style() {
+    if (!style_pending()) return;
+    transition(applied_style_, pending_style_);
+    applied_style_ = pending_style_;
+  }
+
   std::vector<tty::Style> style_stack_;
+
+ private:
+  Style pending_style_;
+  Style applied_style_;
 };
 
 class StdoutWriter : public Writer {
@@ -37,72 +127,116 @@ class StdoutWriter : public Writer {
   void put(const char* text, size_t len) final { std::cout.write(text, len); }
 
   void transition(const Style& from, const Style& to) final {
-    if (from == to) return;
+    std::string buffer;
+    append_transition(&buffer, from, to);
+    std::cout << buffer;
+  }
 
-    bool first = true;
+  void end_line() final {
+    std::cout << std::endl;
+    if (std::cout.bad())
+      throw std::runtime_error{"write to standard output failed"};
+  }
+};
 
-    std::cout << "\033[";
+// Collects output for a file descriptor, and writes it in large blocks.
+class OutputBuffer {
+ public:
+  explicit OutputBuffer(int fd) : fd_{fd} {}
 
-    if (to != Style{}) {
-      if (from.bold_ != to.bold_) {
-        std::cout << (to.bold_ ? "1" : "22");
-        first = false;
-      }
+  ~OutputBuffer() {
+    try {
+      flush();
+    } catch (std::runtime_error&) {
+    }
+  }
 
-      if (from.fg_ != to.fg_ && to.fg_ <= 9) {
-        if (!first) std::cout << ';';
-        std::cout << (30 + to.fg_);
-        first = false;
-      }
+  OutputBuffer(const OutputBuffer&) = delete;
+  OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+  void append(const char* text, size_t len) {
+    buffer_.append(text, len);
+    if (buffer_.size() >= kFlushSize) flush();
+  }
 
-      if (from.bg_ != to.bg_ && to.bg_ <= 9) {
-        if (!first) std::cout << ';';
-        std::cout << (40 + to.fg_);
-        first = false;
+  void append(const std::string& text) { append(text.data(), text.size()); }
+
+  void flush() {
+    size_t offset = 0;
+    while (offset < buffer_.size()) {
+      const auto ret =
+          write(fd_, buffer_.data() + offset, buffer_.size() - offset);
+      if (ret == -1) {
+        if (errno == EINTR) continue;
+        buffer_.clear();
+        throw std::runtime_error{"write to standard output failed"};
       }
+      offset += ret;
     }
-
-    std::cout << 'm';
+    buffer_.clear();
   }
+
+ private:
+  enum : size_t { kFlushSize = 64 * 1024 };
+
+  const int fd_;
+  std::string buffer_;
 };
 
-class PromptWriter : public Writer {
+// Writes lines without any styling.
+class PlainWriter : public Writer {
  public:
-  PromptWriter(std::string& buffer) : buffer_{buffer} {}
+  PlainWriter(OutputBuffer& output) : output_{output} {}
 
-  void put(const char* text, size_t len) final { buffer_.append(text, len); }
+  void put(const char* text, size_t len) final { output_.append(text, len); }
 
-  void transition(const Style& from, const Style& to) final {
-    if (from == to) return;
+  void transition(const Style& from, const Style& to) final {}
 
-    bool first = true;
+  void end_line() final { output_.append("\n", 1); }
 
-    buffer_.append("\033[");
+ private:
+  OutputBuffer& output_;
+};
 
-    if (to != Style{}) {
-      if (from.bold_ != to.bold_) {
-        buffer_.append(to.bold_ ? "1" : "22");
-        first = false;
-      }
+// Writes each line as a JSON object on a line of its own, without styling.
+class JsonLineWriter : public Writer {
+ public:
+  JsonLineWriter(OutputBuffer& output) : output_{output} {}
 
-      if (from.fg_ != to.fg_ && to.fg_ <= 9) {
-        if (!first) buffer_.push_back(';');
-        buffer_.append(std::to_string(30 + to.fg_));
-        first = false;
-      }
+  void put(const char* text, size_t len) final { text_.append(text, len); }
 
-      if (from.bg_ != to.bg_ && to.bg_ <= 9) {
-        if (!first) buffer_.push_back(';');
-        buffer_.append(std::to_string(40 + to.fg_));
-        first = false;
-      }
-    }
+  void transition(const Style& from, const Style& to) final {}
+
+  void end_line() final {
+    std::string event;
+    json::object_writer writer{&event};
+    writer.add("type", "line");
+    writer.add("text", text_);
+    writer.close();
+    event.push_back('\n');
+    output_.append(event);
+  }
+
+ private:
+  OutputBuffer& output_;
+  std::string text_;
+};
+
+class PromptWriter : public Writer {
+ public:
+  // If `styled` is false, styles are ignored.
+  PromptWriter(std::string& buffer, bool styled = true)
+      : buffer_{buffer}, styled_{styled} {}
 
-    buffer_.append("m");
+  void put(const char* text, size_t len) final { buffer_.append(text, len); }
+
+  void transition(const Style& from, const Style& to) final {
+    if (styled_) append_transition(&buffer_, from, to);
   }
 
  private:
   std::string& buffer_;
+  const bool styled_;
 };
 
 }  // namespace tty
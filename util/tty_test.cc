@@ -0,0 +1,69 @@
+#include "util/tty.h"
+
+#include <cstring>
+
+#include "third_party/gtest/include/gtest/gtest.h"
+
+namespace {
+
+tty::Style make_style(unsigned int fg, bool bold = false) {
+  tty::Style result;
+  result.fg_ = fg;
+  result.bold_ = bold;
+  return result;
+}
+
+TEST(TtyTest, Transition) {
+  std::string output;
+  tty::append_transition(&output, tty::Style{}, make_style(1, true));
+  tty::append_transition(&output, make_style(1, true), make_style(2, true));
+  tty::append_transition(&output, make_style(2, true), make_style(2, true));
+  tty::append_transition(&output, make_style(2, true), tty::Style{});
+  EXPECT_EQ("\033[1;31m\033[32m\033[m", output);
+}
+
+TEST(TtyTest, StylesApplyToText) {
+  std::string output;
+  tty::PromptWriter writer{output};
+
+  writer.write("a", 1);
+  writer.set_style(make_style(1));
+  writer.write("b", 1);
+  writer.set_style(make_style(2));
+  writer.write("c", 1);
+  writer.set_style(tty::Style{});
+  writer.apply_style();
+
+  EXPECT_EQ("a\033[31mb\033[32mc\033[m", output);
+}
+
+TEST(TtyTest, StylesWithoutTextCostNothing) {
+  std::string output;
+  tty::PromptWriter writer{output};
+
+  writer.set_style(make_style(1));
+  writer.set_style(make_style(2, true));
+  writer.set_style(tty::Style{});
+  writer.write("a", 1);
+  writer.set_style(make_style(3));
+  writer.set_style(tty::Style{});
+  writer.apply_style();
+
+  EXPECT_EQ("a", output);
+}
+
+TEST(TtyTest, EqualRunsAreMerged) {
+  std::string output;
+  tty::PromptWriter writer{output};
+
+  for (const auto word : {"one ", "two ", "three"}) {
+    writer.set_style(make_style(2));
+    writer.write(word, std::strlen(word));
+    writer.set_style(tty::Style{});
+  }
+  writer.apply_style();
+
+  EXPECT_EQ("\033[32mone two three\033[m", output);
+}
+
+}  // namespace
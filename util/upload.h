@@ -0,0 +1,156 @@
+#pragma once
+
+// Streams files for upload without holding them in memory.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "util/string.h"
+
+namespace upload {
+
+// Reads a file in bounded chunks, optionally gzip compressing it on the fly,
+// so memory use stays flat regardless of the file size.
+//
+// The file is read with pread rather than through a memory mapping: touching
+// a mapped page past the end of a file that shrank after it was mapped
+// raises SIGBUS, while pread reports the short read, and the upload fails
+// with an error instead.  Growth after the size was taken is not sent.
+class file_reader {
+ public:
+  file_reader(const std::string& path, bool gzip) : path_{path}, gzip_{gzip} {
+    fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ == -1)
+      throw std::system_error{errno, std::system_category(),
+                              string::cat("opening ", path, " failed")};
+
+    struct stat st;
+    if (-1 == fstat(fd_, &st)) {
+      const auto error = errno;
+      close(fd_);
+      throw std::system_error{error, std::system_category(),
+                              string::cat("fstat on ", path, " failed")};
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+      close(fd_);
+      throw std::runtime_error{string::cat(path, " is not a regular file")};
+    }
+
+    size_ = st.st_size;
+
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    if (gzip_) {
+      std::memset(&stream_, 0, sizeof(stream_));
+      // 15 window bits, plus 16 for a gzip header instead of a zlib header.
+      if (Z_OK != deflateInit2(&stream_, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                               15 + 16, 8, Z_DEFAULT_STRATEGY)) {
+        close(fd_);
+        throw std::runtime_error{"deflateInit2 failed"};
+      }
+    }
+  }
+
+  ~file_reader() {
+    if (gzip_) deflateEnd(&stream_);
+    close(fd_);
+  }
+
+  file_reader(const file_reader&) = delete;
+  file_reader& operator=(const file_reader&) = delete;
+
+  // Returns the number of bytes `read` produces in total, or -1 if that is not
+  // known in advance.
+  std::int64_t size() const { return gzip_ ? -1 : size_; }
+
+  // Stores up to `size` bytes of the stream in `buffer`, and returns the
+  // number of bytes stored.  Returns 0 at the end of the stream.  Throws if
+  // the file can no longer be read in full.
+  size_t read(char* buffer, size_t size) {
+    if (!gzip_) return read_file(buffer, std::min(size, size_ - offset_));
+
+    if (input_.empty()) input_.resize(kChunkSize);
+
+    stream_.next_out = reinterpret_cast<Bytef*>(buffer);
+    stream_.avail_out = std::min<size_t>(size, UINT32_MAX);
+
+    while (stream_.avail_out > 0 && !stream_end_) {
+      if (stream_.avail_in == 0 && offset_ < size_) {
+        stream_.next_in = reinterpret_cast<Bytef*>(input_.data());
+        stream_.avail_in = read_file(
+            input_.data(), std::min<size_t>(size_ - offset_, kChunkSize));
+      }
+
+      const auto ret =
+          deflate(&stream_, (offset_ == size_) ? Z_FINISH : Z_NO_FLUSH);
+      if (ret == Z_STREAM_END)
+        stream_end_ = true;
+      else if (ret != Z_OK && ret != Z_BUF_ERROR)
+        throw std::runtime_error{"deflate failed"};
+    }
+
+    return reinterpret_cast<char*>(stream_.next_out) - buffer;
+  }
+
+  // Restarts the stream from the beginning.
+  void rewind() {
+    offset_ = 0;
+
+    if (gzip_) {
+      deflateReset(&stream_);
+      stream_.avail_in = 0;
+      stream_end_ = false;
+    }
+  }
+
+ private:
+  enum : size_t { kChunkSize = 1 << 16 };
+
+  // Reads exactly `size` bytes from the current offset into `buffer`, and
+  // returns `size`.
+  size_t read_file(char* buffer, size_t size) {
+    for (size_t done = 0; done < size;) {
+      const auto ret = pread(fd_, buffer + done, size - done, offset_ + done);
+      if (ret == -1) {
+        if (errno == EINTR) continue;
+        throw std::system_error{errno, std::system_category(),
+                                string::cat("reading ", path_, " failed")};
+      }
+      if (ret == 0)
+        throw std::runtime_error{
+            string::cat(path_, " became shorter while being uploaded")};
+      done += ret;
+    }
+
+    offset_ += size;
+
+    return size;
+  }
+
+  const std::string path_;
+  const bool gzip_;
+
+  int fd_ = -1;
+  size_t size_ = 0;
+  size_t offset_ = 0;
+
+  // Holds file data waiting to be compressed.
+  std::vector<char> input_;
+
+  z_stream stream_;
+  bool stream_end_ = false;
+};
+
+}  // namespace upload
@@ -0,0 +1,136 @@
+#include "util/upload.h"
+
+#include <random>
+#include <vector>
+
+#include "third_party/gtest/include/gtest/gtest.h"
+
+namespace {
+
+class UploadTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    char path[] = "/tmp/upload_test.XXXXXX";
+    const auto fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    path_ = path;
+
+    // Compressible, but not trivially so.
+    std::mt19937 rng{1234};
+    for (size_t i = 0; i < 3000000; ++i)
+      data_.push_back("abcdefgh"[rng() % 8]);
+
+    ASSERT_EQ(static_cast<ssize_t>(data_.size()),
+              write(fd, data_.data(), data_.size()));
+    close(fd);
+  }
+
+  void TearDown() override { unlink(path_.c_str()); }
+
+  static std::string read_all(upload::file_reader* reader) {
+    std::string result;
+    std::vector<char> buffer(65536);
+    while (const auto amount = reader->read(buffer.data(), buffer.size()))
+      result.append(buffer.data(), amount);
+    return result;
+  }
+
+  static std::string gunzip(const std::string& input) {
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    EXPECT_EQ(Z_OK, inflateInit2(&stream, 15 + 16));
+
+    std::string result;
+    std::vector<char> buffer(65536);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = input.size();
+
+    int ret;
+    do {
+      stream.next_out = reinterpret_cast<Bytef*>(buffer.data());
+      stream.avail_out = buffer.size();
+      ret = inflate(&stream, Z_NO_FLUSH);
+      EXPECT_TRUE(ret == Z_OK || ret == Z_STREAM_END);
+      result.append(buffer.data(), buffer.size() - stream.avail_out);
+    } while (ret == Z_OK);
+
+    inflateEnd(&stream);
+
+    return result;
+  }
+
+  std::string path_;
+  std::string data_;
+};
+
+TEST_F(UploadTest, Plain) {
+  upload::file_reader reader{path_, false};
+
+  EXPECT_EQ(static_cast<std::int64_t>(data_.size()), reader.size());
+  EXPECT_EQ(data_, read_all(&reader));
+
+  reader.rewind();
+  EXPECT_EQ(data_, read_all(&reader));
+}
+
+TEST_F(UploadTest, Gzip) {
+  upload::file_reader reader{path_, true};
+
+  EXPECT_EQ(-1, reader.size());
+
+  const auto compressed = read_all(&reader);
+  EXPECT_LT(compressed.size(), data_.size() / 2);
+  EXPECT_EQ(data_, gunzip(compressed));
+
+  reader.rewind();
+  EXPECT_EQ(compressed, read_all(&reader));
+}
+
+TEST_F(UploadTest, SmallReads) {
+  upload::file_reader reader{path_, true};
+
+  std::string compressed;
+  char buffer[7];
+  while (const auto amount = reader.read(buffer, sizeof(buffer)))
+    compressed.append(buffer, amount);
+
+  EXPECT_EQ(data_, gunzip(compressed));
+}
+
+TEST_F(UploadTest, Empty) {
+  ASSERT_EQ(0, truncate(path_.c_str(), 0));
+
+  upload::file_reader plain{path_, false};
+  EXPECT_EQ("", read_all(&plain));
+
+  upload::file_reader compressed{path_, true};
+  EXPECT_EQ("", gunzip(read_all(&compressed)));
+}
+
+TEST_F(UploadTest, Shrinking) {
+  upload::file_reader reader{path_, false};
+
+  std::vector<char> buffer(65536);
+  reader.read(buffer.data(), buffer.size());
+
+  ASSERT_EQ(0, truncate(path_.c_str(), 100000));
+  EXPECT_THROW(read_all(&reader), std::runtime_error);
+}
+
+TEST_F(UploadTest, ShrinkingGzip) {
+  upload::file_reader reader{path_, true};
+
+  std::vector<char> buffer(65536);
+  reader.read(buffer.data(), buffer.size());
+
+  ASSERT_EQ(0, truncate(path_.c_str(), 1000000));
+  EXPECT_THROW(read_all(&reader), std::runtime_error);
+}
+
+TEST_F(UploadTest, Missing) {
+  EXPECT_THROW(upload::file_reader(path_ + ".missing", false),
+               std::system_error);
+  EXPECT_THROW(upload::file_reader("/tmp", false), std::runtime_error);
+}
+
+}  // namespace
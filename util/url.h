@@ -1,7 +1,7 @@
 #pragma once
 
+#include <algorithm>
 #include <cctype>
-#include <cstring>
 #include <string>
 
 #include "util/path.h"
@@ -31,18 +31,56 @@ struct parts {
   std::string fragment;
 };
 
+namespace internal {
+
+// Bytes that are copied verbatim by `escape`.
+struct safe_bytes {
+  safe_bytes() {
+    for (int ch = '0'; ch <= '9'; ++ch) safe[ch] = true;
+    for (int ch = 'A'; ch <= 'Z'; ++ch) safe[ch] = true;
+    for (int ch = 'a'; ch <= 'z'; ++ch) safe[ch] = true;
+    for (auto p = "-_()"; *p; ++p) safe[static_cast<unsigned char>(*p)] = true;
+  }
+
+  bool operator[](char ch) const {
+    return safe[static_cast<unsigned char>(ch)];
+  }
+
+  bool safe[256] = {};
+};
+
+}  // namespace internal
+
+// Appends `input` to `output`, percent-encoding all bytes except
+// alphanumerics and "-_()".
 inline void escape(std::string* output, const std::string& input) {
   static const char hex_digits[] = "0123456789ABCDEF";
-
-  for (const char ch : input) {
-    if ((ch >= '0' && ch <= '9') || (ch >= 'A' && ch <= 'Z') ||
-        (ch >= 'a' && ch <= 'z') || nullptr != std::strchr("-_()", ch)) {
-      output->push_back(ch);
-    } else {
-      output->push_back('%');
-      output->push_back(hex_digits[static_cast<unsigned char>(ch) >> 4]);
-      output->push_back(hex_digits[static_cast<unsigned char>(ch) & 15]);
+  static const internal::safe_bytes safe;
+
+  // Bytes are encoded one by one into a buffer on the stack, which is then
+  // appended in one go.  This is faster than copying runs of safe bytes with
+  // memcpy when the runs are short, as in text, and saves counting the bytes
+  // to encode up front to size the output.
+  static const size_t kBlockSize = 256;
+  char buffer[3 * kBlockSize];
+
+  const auto end = input.data() + input.size();
+  for (auto p = input.data(); p != end;) {
+    const auto block_end = p + std::min<size_t>(end - p, kBlockSize);
+
+    size_t length = 0;
+    for (; p != block_end; ++p) {
+      if (safe[*p]) {
+        buffer[length++] = *p;
+      } else {
+        buffer[length] = '%';
+        buffer[length + 1] = hex_digits[static_cast<unsigned char>(*p) >> 4];
+        buffer[length + 2] = hex_digits[static_cast<unsigned char>(*p) & 15];
+        length += 3;
+      }
     }
+
+    output->append(buffer, length);
   }
 }
 
@@ -58,7 +96,7 @@ inline void append_key_value(std::string* output, const std::string& key,
 //
 // If the path component is implicitly "/", like in <http://www.example.org>,
 // the resulting object may contain a path even though the URL itself does not.
-parts parse(const std::string& url) {
+inline parts parse(const std::string& url) {
   parts result;
 
   std::string::size_type pos = 0;
@@ -113,7 +151,8 @@ parts parse(const std::string& url) {
 
 // Computes the absolute URL from an optionally relative URL, and an absolute
 // URL.
-std::string normalize(const std::string& url, const std::string& base) {
+inline std::string normalize(const std::string& url,
+                             const std::string& base) {
   const auto base_parts = parse(base);
   auto url_parts = parse(url);
 
@@ -143,4 +182,130 @@ std::string normalize(const std::string& url, const std::string& base) {
   return url;
 }
 
+namespace internal {
+
+// The components of a URI reference, as split by the regular expression in
+// appendix B of RFC 3986.  Each component includes its delimiters, so that
+// an empty query ("?") can be told from none.
+struct components {
+  std::string scheme;     // "http:"
+  std::string authority;  // "//www.example.org"
+  std::string path;
+  std::string query;     // "?a=b"
+  std::string fragment;  // "#c"
+};
+
+inline components split(const std::string& url) {
+  components result;
+
+  std::string::size_type pos = 0;
+
+  const auto scheme_end = url.find_first_of(":/?#");
+  if (scheme_end != std::string::npos && scheme_end > 0 &&
+      url[scheme_end] == ':') {
+    result.scheme = url.substr(0, scheme_end + 1);
+    for (auto& ch : result.scheme) ch = string::ascii_tolower(ch);
+    pos = scheme_end + 1;
+  }
+
+  if (0 == url.compare(pos, 2, "//")) {
+    const auto end = std::min(url.find_first_of("/?#", pos + 2), url.size());
+    result.authority = url.substr(pos, end - pos);
+    pos = end;
+  }
+
+  const auto path_end = std::min(url.find_first_of("?#", pos), url.size());
+  result.path = url.substr(pos, path_end - pos);
+  pos = path_end;
+
+  if (pos < url.size() && url[pos] == '?') {
+    const auto end = std::min(url.find('#', pos), url.size());
+    result.query = url.substr(pos, end - pos);
+    pos = end;
+  }
+
+  result.fragment = url.substr(pos);
+
+  return result;
+}
+
+// Removes "." and ".." segments from `input`, as described in section 5.2.4
+// of RFC 3986.
+inline std::string remove_dot_segments(std::string input) {
+  std::string output;
+
+  const auto remove_last_segment = [&output] {
+    const auto slash = output.rfind('/');
+    output.erase((slash == std::string::npos) ? 0 : slash);
+  };
+
+  while (!input.empty()) {
+    if (string::starts_with(input, "../")) {
+      input.erase(0, 3);
+    } else if (string::starts_with(input, "./") ||
+               string::starts_with(input, "/./")) {
+      input.erase(0, 2);
+    } else if (input == "/.") {
+      input = "/";
+    } else if (string::starts_with(input, "/../")) {
+      input.erase(0, 3);
+      remove_last_segment();
+    } else if (input == "/..") {
+      input = "/";
+      remove_last_segment();
+    } else if (input == "." || input == "..") {
+      input.clear();
+    } else {
+      const auto end = std::min(input.find('/', 1), input.size());
+      output.append(input, 0, end);
+      input.erase(0, end);
+    }
+  }
+
+  return output;
+}
+
+}  // namespace internal
+
+// Resolves `reference` against the absolute URL `base`, as described in
+// section 5.2 of RFC 3986.  Unlike `normalize`, which treats the whole path
+// of `base` as a directory, this drops the last segment and the query of
+// `base`, as HTTP requires for the Location header.
+inline std::string resolve(const std::string& reference,
+                           const std::string& base) {
+  using internal::remove_dot_segments;
+
+  const auto r = internal::split(reference);
+  const auto b = internal::split(base);
+
+  if (!r.scheme.empty()) {
+    return string::cat(r.scheme, r.authority, remove_dot_segments(r.path),
+                       r.query, r.fragment);
+  }
+
+  if (!r.authority.empty()) {
+    return string::cat(b.scheme, r.authority, remove_dot_segments(r.path),
+                       r.query, r.fragment);
+  }
+
+  if (r.path.empty()) {
+    return string::cat(b.scheme, b.authority, b.path,
+                       r.query.empty() ? b.query : r.query, r.fragment);
+  }
+
+  std::string path;
+  if (r.path[0] == '/') {
+    path = r.path;
+  } else if (!b.authority.empty() && b.path.empty()) {
+    path = "/" + r.path;
+  } else {
+    const auto slash = b.path.rfind('/');
+    if (slash != std::string::npos) path = b.path.substr(0, slash + 1);
+    path += r.path;
+  }
+
+  return string::cat(b.scheme, b.authority, remove_dot_segments(path),
+                     r.query, r.fragment);
+}
+
 }  // namespace url
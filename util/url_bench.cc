@@ -0,0 +1,64 @@
+// Measures the throughput of url::escape on payloads resembling the hidden
+// state pages keep in <var> elements.
+
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "util/bench.h"
+#include "util/url.h"
+
+namespace {
+
+std::string make_payload(const char* alphabet, size_t size) {
+  const std::string chars{alphabet};
+  std::mt19937 rng{1234};
+  std::uniform_int_distribution<size_t> pick{0, chars.size() - 1};
+
+  std::string result;
+  result.reserve(size);
+  while (result.size() < size) result.push_back(chars[pick(rng)]);
+  return result;
+}
+
+std::string make_binary_payload(size_t size) {
+  std::mt19937 rng{1234};
+  std::string result;
+  result.reserve(size);
+  while (result.size() < size) result.push_back(static_cast<char>(rng()));
+  return result;
+}
+
+void run(const char* name, const std::string& payload) {
+  std::string output;
+
+  // Count each input byte as one operation.
+  const auto r = bench::run(
+      name,
+      [&] {
+        output.clear();
+        url::append_key_value(&output, "state", payload);
+        bench::do_not_optimize(output);
+      },
+      payload.size());
+
+  std::printf("%-32s %12.1f MB/s\n", "", 1e3 / r.ns_per_op);
+}
+
+}  // namespace
+
+int main() {
+  static const size_t kSize = 256 * 1024;
+
+  run("alphanumeric",
+      make_payload(
+          "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
+          kSize));
+  run("base64",
+      make_payload(
+          "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/",
+          kSize));
+  run("text", make_payload("eeeeetaoinshrdlu     ,.\n", kSize));
+  run("binary", make_binary_payload(kSize));
+  run("small", make_payload("abcdefgh ", 32));
+}
@@ -33,6 +33,37 @@ TEST(UrlTest, Parse) {
   EXPECT_EQ(url::parts("", "", "/abc", ""), url::parse("/abc"));
 }
 
+TEST(UrlTest, Escape) {
+  std::string output;
+  url::escape(&output, "abc-XYZ_019()");
+  EXPECT_EQ("abc-XYZ_019()", output);
+
+  output = "x=";
+  url::escape(&output, "a b&c/\xc3\xa6");
+  EXPECT_EQ("x=a%20b%26c%2F%C3%A6", output);
+
+  output.clear();
+  url::escape(&output, std::string{"a\0b", 3});
+  EXPECT_EQ("a%00b", output);
+
+  output.clear();
+  url::escape(&output, "");
+  EXPECT_EQ("", output);
+
+  std::string input(10000, 'a');
+  input[5000] = '.';
+  output.clear();
+  url::escape(&output, input);
+  EXPECT_EQ(std::string(5000, 'a') + "%2E" + std::string(4999, 'a'), output);
+}
+
+TEST(UrlTest, AppendKeyValue) {
+  std::string output;
+  url::append_key_value(&output, "a", "1 2");
+  url::append_key_value(&output, "b c", "");
+  EXPECT_EQ("a=1%202&b%20c=", output);
+}
+
 TEST(UrlTest, Base) {
   EXPECT_EQ("http://www.example.org/def#jkl",
             url::normalize("#jkl", "http://www.example.org/def#ghi"));
@@ -63,4 +94,61 @@ TEST(UrlTest, Relative) {
             url::normalize("../../.", "http://www.example.org/def/ghi"));
 }
 
+// The examples of section 5.4 of RFC 3986.
+TEST(UrlTest, Resolve) {
+  const char base[] = "http://a/b/c/d;p?q";
+
+  const char* const examples[][2] = {
+      {"g:h", "g:h"},
+      {"g", "http://a/b/c/g"},
+      {"./g", "http://a/b/c/g"},
+      {"g/", "http://a/b/c/g/"},
+      {"/g", "http://a/g"},
+      {"//g", "http://g"},
+      {"?y", "http://a/b/c/d;p?y"},
+      {"g?y", "http://a/b/c/g?y"},
+      {"#s", "http://a/b/c/d;p?q#s"},
+      {"g#s", "http://a/b/c/g#s"},
+      {"g?y#s", "http://a/b/c/g?y#s"},
+      {";x", "http://a/b/c/;x"},
+      {"g;x", "http://a/b/c/g;x"},
+      {"g;x?y#s", "http://a/b/c/g;x?y#s"},
+      {"", "http://a/b/c/d;p?q"},
+      {".", "http://a/b/c/"},
+      {"./", "http://a/b/c/"},
+      {"..", "http://a/b/"},
+      {"../", "http://a/b/"},
+      {"../g", "http://a/b/g"},
+      {"../..", "http://a/"},
+      {"../../", "http://a/"},
+      {"../../g", "http://a/g"},
+      {"../../../g", "http://a/g"},
+      {"../../../../g", "http://a/g"},
+      {"/./g", "http://a/g"},
+      {"/../g", "http://a/g"},
+      {"g.", "http://a/b/c/g."},
+      {".g", "http://a/b/c/.g"},
+      {"g..", "http://a/b/c/g.."},
+      {"..g", "http://a/b/c/..g"},
+      {"./../g", "http://a/b/g"},
+      {"./g/.", "http://a/b/c/g/"},
+      {"g/./h", "http://a/b/c/g/h"},
+      {"g/../h", "http://a/b/c/h"},
+      {"g;x=1/./y", "http://a/b/c/g;x=1/y"},
+      {"g;x=1/../y", "http://a/b/c/y"},
+      {"g?y/./x", "http://a/b/c/g?y/./x"},
+      {"g?y/../x", "http://a/b/c/g?y/../x"},
+      {"g#s/./x", "http://a/b/c/g#s/./x"},
+      {"g#s/../x", "http://a/b/c/g#s/../x"},
+  };
+
+  for (const auto& example : examples)
+    EXPECT_EQ(example[1], url::resolve(example[0], base)) << example[0];
+
+  EXPECT_EQ("http://a/g", url::resolve("g", "http://a"));
+  EXPECT_EQ("http://a/r302rel/page?x=1",
+            url::resolve("sub/../page?x=1", "http://a/r302rel/x"));
+}
+
 }  // namespace
+
@@ -0,0 +1,100 @@
+#pragma once
+
+// Helper functions for dealing with UTF-8 encoded text.
+
+#include <string>
+
+namespace utf8 {
+
+// Decodes the code point starting at `*p`, and advances `*p` past it.
+//
+// Invalid or truncated sequences decode as U+FFFD, consuming a single byte.
+inline char32_t decode(const char** p, const char* end) {
+  const auto s = reinterpret_cast<const unsigned char*>(*p);
+  const auto avail = end - *p;
+
+  if (s[0] < 0x80) {
+    ++*p;
+    return s[0];
+  }
+
+  int len;
+  char32_t result;
+
+  if ((s[0] & 0xe0) == 0xc0) {
+    len = 2;
+    result = s[0] & 0x1f;
+  } else if ((s[0] & 0xf0) == 0xe0) {
+    len = 3;
+    result = s[0] & 0x0f;
+  } else if ((s[0] & 0xf8) == 0xf0) {
+    len = 4;
+    result = s[0] & 0x07;
+  } else {
+    ++*p;
+    return 0xfffd;
+  }
+
+  if (avail < len) {
+    ++*p;
+    return 0xfffd;
+  }
+
+  for (int i = 1; i < len; ++i) {
+    if ((s[i] & 0xc0) != 0x80) {
+      ++*p;
+      return 0xfffd;
+    }
+    result = (result << 6) | (s[i] & 0x3f);
+  }
+
+  *p += len;
+
+  return result;
+}
+
+inline void encode(std::string* output, char32_t ch) {
+  if (ch < 0x80) {
+    output->push_back(ch);
+  } else if (ch < 0x800) {
+    output->push_back(0xc0 | (ch >> 6));
+    output->push_back(0x80 | (ch & 0x3f));
+  } else if (ch < 0x10000) {
+    output->push_back(0xe0 | (ch >> 12));
+    output->push_back(0x80 | ((ch >> 6) & 0x3f));
+    output->push_back(0x80 | (ch & 0x3f));
+  } else {
+    output->push_back(0xf0 | (ch >> 18));
+    output->push_back(0x80 | ((ch >> 12) & 0x3f));
+    output->push_back(0x80 | ((ch >> 6) & 0x3f));
+    output->push_back(0x80 | (ch & 0x3f));
+  }
+}
+
+// Returns the number of terminal columns occupied by a code point.
+//
+// This does not depend on the current locale, so that layout is the same
+// regardless of how the process was started.
+inline unsigned int width(char32_t ch) {
+  if (ch < 0x20 || (ch >= 0x7f && ch < 0xa0)) return 0;
+
+  // Combining marks and zero width characters.
+  if ((ch >= 0x0300 && ch <= 0x036f) || (ch >= 0x200b && ch <= 0x200f) ||
+      (ch >= 0x20d0 && ch <= 0x20ff) || (ch >= 0xfe00 && ch <= 0xfe0f))
+    return 0;
+
+  // East Asian wide and full width characters.
+  if (ch >= 0x1100 &&
+      (ch <= 0x115f || ch == 0x2329 || ch == 0x232a ||
+       (ch >= 0x2e80 && ch <= 0xa4cf && ch != 0x303f) ||
+       (ch >= 0xac00 && ch <= 0xd7a3) || (ch >= 0xf900 && ch <= 0xfaff) ||
+       (ch >= 0xfe10 && ch <= 0xfe19) || (ch >= 0xfe30 && ch <= 0xfe6f) ||
+       (ch >= 0xff00 && ch <= 0xff60) || (ch >= 0xffe0 && ch <= 0xffe6) ||
+       (ch >= 0x1f300 && ch <= 0x1f64f) || (ch >= 0x1f900 && ch <= 0x1f9ff) ||
+       (ch >= 0x20000 && ch <= 0x2fffd) || (ch >= 0x30000 && ch <= 0x3fffd)))
+    return 2;
+
+  return 1;
+}
+
+}  // namespace utf8
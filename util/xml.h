@@ -0,0 +1,702 @@
+#pragma once
+
+// A fast parser for the subset of XML that ttyml pages use, reporting the
+// same events as Expat does in namespace mode.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "util/string.h"
+#include "util/utf8.h"
+
+namespace xml {
+
+namespace internal {
+
+// Bytes allowed in element and attribute names.  Names outside ASCII, and
+// names with a namespace prefix, are left to the general parser.
+struct name_bytes {
+  name_bytes() {
+    for (int ch = 'A'; ch <= 'Z'; ++ch) start[ch] = rest[ch] = true;
+    for (int ch = 'a'; ch <= 'z'; ++ch) start[ch] = rest[ch] = true;
+    for (int ch = '0'; ch <= '9'; ++ch) rest[ch] = true;
+    start['_'] = rest['_'] = true;
+    rest['-'] = rest['.'] = true;
+  }
+
+  bool start[256] = {};
+  bool rest[256] = {};
+};
+
+inline bool is_space(char ch) {
+  return ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r';
+}
+
+inline bool is_xml_char(char32_t ch) {
+  return (ch >= 0x20 && ch <= 0xd7ff) || ch == 0x9 || ch == 0xa || ch == 0xd ||
+         (ch >= 0xe000 && ch <= 0xfffd) || (ch >= 0x10000 && ch <= 0x10ffff);
+}
+
+// Returns the first byte in [p, end) that is `a`, `b` or `c`, a control
+// character, or part of a UTF-8 sequence.  Sixteen bytes are checked at a
+// time where SSE2 is available.
+inline const char* find_special(const char* p, const char* end, char a,
+                                char b, char c) {
+#ifdef __SSE2__
+  const auto va = _mm_set1_epi8(a);
+  const auto vb = _mm_set1_epi8(b);
+  const auto vc = _mm_set1_epi8(c);
+  // Bytes from 0x80 are negative, so a signed comparison finds both these
+  // and control characters.
+  const auto space = _mm_set1_epi8(0x20);
+
+  for (; end - p >= 16; p += 16) {
+    const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const auto hits = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)),
+        _mm_or_si128(_mm_cmpeq_epi8(v, vc), _mm_cmplt_epi8(v, space)));
+    const auto mask = _mm_movemask_epi8(hits);
+    if (mask) return p + __builtin_ctz(mask);
+  }
+#endif
+
+  for (; p != end; ++p) {
+    const auto ch = static_cast<unsigned char>(*p);
+    if (ch < 0x20 || ch >= 0x80 || *p == a || *p == b || *p == c) break;
+  }
+  return p;
+}
+
+// Returns the length of the UTF-8 sequence starting at `p` if it encodes a
+// character allowed in XML, -1 if it is cut short by `end`, and 0 otherwise.
+inline int utf8_length(const char* p, const char* end) {
+  const auto s = reinterpret_cast<const unsigned char*>(p);
+
+  int length;
+  char32_t ch, min;
+  if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+    length = 2;
+    ch = s[0] & 0x1f;
+    min = 0x80;
+  } else if ((s[0] & 0xf0) == 0xe0) {
+    length = 3;
+    ch = s[0] & 0x0f;
+    min = 0x800;
+  } else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+    length = 4;
+    ch = s[0] & 0x07;
+    min = 0x10000;
+  } else {
+    return 0;
+  }
+
+  for (int i = 1; i < length; ++i) {
+    if (i >= end - p) return -1;
+    if ((s[i] & 0xc0) != 0x80) return 0;
+    ch = (ch << 6) | (s[i] & 0x3f);
+  }
+
+  return (ch >= min && is_xml_char(ch)) ? length : 0;
+}
+
+}  // namespace internal
+
+// Parses UTF-8 encoded documents made of an optional XML declaration,
+// elements, attributes, text, character references and the predefined
+// entities, with unprefixed namespace declarations.  Text and attribute
+// values are scanned with SIMD instructions where available.
+//
+// Element names are reported as Expat reports them with
+// XML_ParserCreateNS: the namespace URI and the local name joined by the
+// separator, or just the local name outside any namespace.  Namespace
+// declarations are not reported as attributes.
+//
+// Anything else, including comments, processing instructions, DTDs, CDATA
+// sections, XML declarations for other versions or encodings, namespace
+// prefixes, names outside ASCII and documents that are not well-formed,
+// makes the parser give up, so that a general parser can finish the
+// document, with its own error messages.
+class fast_parser {
+ public:
+  using start_handler = void (*)(void* user_data, const char* name,
+                                 const char** atts);
+  using end_handler = void (*)(void* user_data, const char* name);
+  using text_handler = void (*)(void* user_data, const char* text, int len);
+
+  fast_parser(void* user_data, start_handler start, end_handler end,
+              text_handler text, char namespace_separator)
+      : user_data_{user_data},
+        start_{start},
+        end_{end},
+        text_{text},
+        separator_{namespace_separator} {}
+
+  // Parses the next `len` bytes of the document, calling the handlers for
+  // each complete tag and for text.  Set `final` for the last part.
+  //
+  // Returns false if the parser gave up.  The handlers are then not called
+  // for the rest of the document, and a general parser can finish it after
+  // being brought to the same state with `prefix()`, and then given
+  // `rest()`.
+  bool parse(const char* data, size_t len, bool final) {
+    if (failed_) return false;
+
+    const auto buffered = !buffer_.empty();
+    if (buffered) {
+      buffer_.append(data, len);
+      data = buffer_.data();
+      len = buffer_.size();
+    }
+
+    auto p = data;
+    const auto end = data + len;
+
+    auto result = status::ok;
+    while (p != end && result == status::ok) {
+      if (*p == '<')
+        result = parse_markup(&p, end);
+      else if (elements_.empty())
+        result = skip_prolog(&p, end);
+      else
+        result = parse_text(&p, end);
+      if (result == status::ok) started_ = true;
+    }
+
+    if (final && (p != end || !root_ended_)) result = status::unsupported;
+
+    // An incomplete tag is parsed again from the start when more input
+    // arrives, so leave very long ones to the general parser.
+    if (result == status::more && end - p > kMaxPending)
+      result = status::unsupported;
+
+    // Keep what could not be parsed yet.
+    if (buffered)
+      buffer_.erase(0, p - data);
+    else if (p != end)
+      buffer_.assign(p, end - p);
+
+    if (result == status::unsupported) failed_ = true;
+
+    return !failed_;
+  }
+
+  // Returns XML that brings a general parser to the state this parser was
+  // in when it gave up, if the general parser's events are ignored: the
+  // start tags of the open elements, an empty element once the document
+  // element has ended, or white space once past the start of the document,
+  // where an XML declaration is no longer allowed.
+  std::string prefix() const {
+    if (root_ended_) return "<_/>";
+    if (tags_.empty() && started_) return " ";
+    return tags_;
+  }
+
+  // Returns the part of the document that was not handled.
+  const std::string& rest() const { return buffer_; }
+
+ private:
+  enum : ptrdiff_t { kMaxPending = 65536 };
+
+  enum class status {
+    ok,
+
+    // The input ends inside a token.
+    more,
+
+    // The parser cannot handle the token.
+    unsupported,
+  };
+
+  struct element {
+    // Offset of the start tag in `tags_`.
+    size_t tag;
+
+    // Offsets of the reported name, and its local part, in `names_`.
+    size_t name;
+    size_t local_name;
+    size_t local_name_length;
+
+    bool declares_namespace;
+  };
+
+  struct attribute {
+    // Offsets of the NUL terminated name and value in `values_`.
+    size_t name;
+    size_t value;
+  };
+
+  status parse_markup(const char** p, const char* end) {
+    if (end - *p < 2) return status::more;
+
+    switch ((*p)[1]) {
+      case '/':
+        return parse_end_tag(p, end);
+
+      case '?':
+        if (started_) return status::unsupported;
+        return parse_declaration(p, end);
+
+      case '!':
+        return status::unsupported;
+
+      default:
+        return parse_start_tag(p, end);
+    }
+  }
+
+  status parse_start_tag(const char** p, const char* end) {
+    if (root_ended_) return status::unsupported;
+
+    auto q = *p + 1;
+    const auto name = q;
+    auto result = parse_name(&q, end);
+    if (result != status::ok) return result;
+    const auto name_end = q;
+
+    attributes_.clear();
+    values_.clear();
+
+    auto empty = false;
+    auto declares_namespace = false;
+    size_t namespace_value = 0;
+
+    for (;;) {
+      const auto space = skip_space(&q, end);
+      if (q == end) return status::more;
+      if (*q == '>') {
+        ++q;
+        break;
+      }
+      if (*q == '/') {
+        if (q + 1 == end) return status::more;
+        if (q[1] != '>') return status::unsupported;
+        q += 2;
+        empty = true;
+        break;
+      }
+
+      // Attributes must be separated by white space.
+      if (!space) return status::unsupported;
+
+      const auto attribute_name = q;
+      result = parse_name(&q, end);
+      if (result != status::ok) return result;
+
+      attribute a;
+      a.name = values_.size();
+      values_.append(attribute_name, q - attribute_name);
+      values_.push_back(0);
+
+      skip_space(&q, end);
+      if (q == end) return status::more;
+      if (*q != '=') return status::unsupported;
+      ++q;
+      skip_space(&q, end);
+      if (q == end) return status::more;
+      if (*q != '"' && *q != '\'') return status::unsupported;
+      const auto quote = *q++;
+
+      a.value = values_.size();
+      result = parse_value(&q, end, quote);
+      if (result != status::ok) return result;
+      values_.push_back(0);
+
+      const auto attribute_name_str = values_.data() + a.name;
+      for (const auto& other : attributes_) {
+        if (0 == std::strcmp(values_.data() + other.name, attribute_name_str))
+          return status::unsupported;
+      }
+      if (declares_namespace &&
+          0 == std::strcmp(attribute_name_str, "xmlns"))
+        return status::unsupported;
+
+      if (0 == std::strcmp(attribute_name_str, "xmlns")) {
+        declares_namespace = true;
+        namespace_value = a.value;
+        continue;
+      }
+
+      attributes_.emplace_back(a);
+    }
+
+    element e;
+    e.tag = tags_.size();
+    e.name = names_.size();
+    e.declares_namespace = declares_namespace;
+
+    if (declares_namespace) {
+      const std::string uri{values_.data() + namespace_value};
+      // Expat refuses to make these the default namespace.
+      if (uri == "http://www.w3.org/XML/1998/namespace" ||
+          uri == "http://www.w3.org/2000/xmlns/")
+        return status::unsupported;
+      namespaces_.emplace_back(uri);
+    }
+
+    if (!namespaces_.empty() && !namespaces_.back().empty()) {
+      names_.append(namespaces_.back());
+      names_.push_back(separator_);
+    }
+    e.local_name = names_.size();
+    e.local_name_length = name_end - name;
+    names_.append(name, name_end - name);
+    names_.push_back(0);
+
+    tags_.append(*p, q - *p);
+
+    atts_.clear();
+    for (const auto& a : attributes_) {
+      atts_.emplace_back(values_.data() + a.name);
+      atts_.emplace_back(values_.data() + a.value);
+    }
+    atts_.emplace_back(nullptr);
+
+    elements_.emplace_back(e);
+    *p = q;
+
+    start_(user_data_, names_.data() + e.name, atts_.data());
+    if (empty) pop();
+
+    return status::ok;
+  }
+
+  status parse_end_tag(const char** p, const char* end) {
+    auto q = *p + 2;
+    const auto name = q;
+    const auto result = parse_name(&q, end);
+    if (result != status::ok) return result;
+    const auto name_length = static_cast<size_t>(q - name);
+
+    skip_space(&q, end);
+    if (q == end) return status::more;
+    if (*q != '>') return status::unsupported;
+    ++q;
+
+    if (elements_.empty()) return status::unsupported;
+    const auto& e = elements_.back();
+    if (name_length != e.local_name_length ||
+        0 != std::memcmp(name, names_.data() + e.local_name, name_length))
+      return status::unsupported;
+
+    *p = q;
+    pop();
+
+    return status::ok;
+  }
+
+  void pop() {
+    const auto e = elements_.back();
+    end_(user_data_, names_.data() + e.name);
+
+    if (e.declares_namespace) namespaces_.pop_back();
+    tags_.resize(e.tag);
+    names_.resize(e.name);
+    elements_.pop_back();
+
+    if (elements_.empty()) root_ended_ = true;
+  }
+
+  status parse_text(const char** p, const char* end) {
+    auto q = *p;
+    auto run = q;
+    auto result = status::ok;
+
+    for (;;) {
+      q = internal::find_special(q, end, '<', '&', ']');
+      if (q == end || *q == '<') break;
+
+      const auto ch = static_cast<unsigned char>(*q);
+      if (ch == '\n' || ch == '\t') {
+        ++q;
+      } else if (ch == ']') {
+        // "]]>" may not appear in text.
+        const auto available = static_cast<size_t>(end - q);
+        if (available < 3 && 0 == std::memcmp(q, "]]>", available)) {
+          result = status::more;
+          break;
+        }
+        if (available >= 3 && q[1] == ']' && q[2] == '>') {
+          result = status::unsupported;
+          break;
+        }
+        ++q;
+      } else if (ch == '\r') {
+        // Line breaks are reported as "\n".
+        if (q + 1 == end) {
+          result = status::more;
+          break;
+        }
+        emit(run, q - run);
+        emit("\n", 1);
+        q += (q[1] == '\n') ? 2 : 1;
+        run = q;
+      } else if (ch == '&') {
+        emit(run, q - run);
+        run = q;
+        scratch_.clear();
+        result = parse_reference(&q, end, &scratch_);
+        if (result != status::ok) break;
+        emit(scratch_.data(), scratch_.size());
+        run = q;
+      } else if (ch < 0x20) {
+        result = status::unsupported;
+        break;
+      } else {
+        const auto length = internal::utf8_length(q, end);
+        if (length <= 0) {
+          result = length ? status::more : status::unsupported;
+          break;
+        }
+        q += length;
+      }
+    }
+
+    emit(run, q - run);
+    *p = q;
+
+    return result;
+  }
+
+  // Appends an attribute value up to the closing quote to `values_`, with
+  // white space normalized as required for attributes without a DTD.
+  status parse_value(const char** p, const char* end, char quote) {
+    auto q = *p;
+
+    for (;;) {
+      const auto run_end = internal::find_special(q, end, quote, '<', '&');
+      values_.append(q, run_end - q);
+      q = run_end;
+      if (q == end) return status::more;
+
+      const auto ch = static_cast<unsigned char>(*q);
+      if (*q == quote) {
+        *p = q + 1;
+        return status::ok;
+      } else if (ch == '<') {
+        return status::unsupported;
+      } else if (ch == '&') {
+        const auto result = parse_reference(&q, end, &values_);
+        if (result != status::ok) return result;
+      } else if (ch == '\r') {
+        if (q + 1 == end) return status::more;
+        values_.push_back(' ');
+        q += (q[1] == '\n') ? 2 : 1;
+      } else if (ch == '\n' || ch == '\t') {
+        values_.push_back(' ');
+        ++q;
+      } else if (ch < 0x20) {
+        return status::unsupported;
+      } else {
+        const auto length = internal::utf8_length(q, end);
+        if (length <= 0) return length ? status::more : status::unsupported;
+        values_.append(q, length);
+        q += length;
+      }
+    }
+  }
+
+  // Appends the character a reference at `*p` stands for to `output`.
+  static status parse_reference(const char** p, const char* end,
+                                std::string* output) {
+    static const struct {
+      const char* name;
+      char ch;
+    } entities[] = {{"lt;", '<'},
+                    {"gt;", '>'},
+                    {"amp;", '&'},
+                    {"quot;", '"'},
+                    {"apos;", '\''}};
+
+    auto q = *p + 1;
+    if (q == end) return status::more;
+
+    if (*q == '#') {
+      if (++q == end) return status::more;
+
+      const auto hex = (*q == 'x');
+      if (hex && ++q == end) return status::more;
+
+      const auto digits = q;
+      char32_t ch = 0;
+      for (;; ++q) {
+        if (q == end) return status::more;
+
+        unsigned int digit;
+        if (*q >= '0' && *q <= '9')
+          digit = *q - '0';
+        else if (hex && *q >= 'a' && *q <= 'f')
+          digit = *q - 'a' + 10;
+        else if (hex && *q >= 'A' && *q <= 'F')
+          digit = *q - 'A' + 10;
+        else
+          break;
+
+        ch = ch * (hex ? 16 : 10) + digit;
+        if (ch > 0x10ffff) return status::unsupported;
+      }
+
+      if (q == digits || *q != ';' || !internal::is_xml_char(ch))
+        return status::unsupported;
+
+      utf8::encode(output, ch);
+      *p = q + 1;
+      return status::ok;
+    }
+
+    const auto available = static_cast<size_t>(end - q);
+    for (const auto& entity : entities) {
+      const auto length = std::strlen(entity.name);
+      if (available < length) {
+        if (0 == std::memcmp(q, entity.name, available)) return status::more;
+      } else if (0 == std::memcmp(q, entity.name, length)) {
+        output->push_back(entity.ch);
+        *p = q + length;
+        return status::ok;
+      }
+    }
+
+    return status::unsupported;
+  }
+
+  static status parse_name(const char** p, const char* end) {
+    static const internal::name_bytes bytes;
+
+    auto q = *p;
+    if (q == end) return status::more;
+    if (!bytes.start[static_cast<unsigned char>(*q)])
+      return status::unsupported;
+
+    do {
+      ++q;
+    } while (q != end && bytes.rest[static_cast<unsigned char>(*q)]);
+
+    // A name is always followed by something.
+    if (q == end) return status::more;
+
+    *p = q;
+    return status::ok;
+  }
+
+  // Returns true if any white space was skipped.
+  static bool skip_space(const char** p, const char* end) {
+    const auto begin = *p;
+    while (*p != end && internal::is_space(**p)) ++*p;
+    return *p != begin;
+  }
+
+  // Parses an XML declaration for version 1.0 and, if it names an encoding at
+  // all, UTF-8.
+  static status parse_declaration(const char** p, const char* end) {
+    auto q = *p + 2;
+    auto result = skip_literal(&q, end, "xml");
+    if (result != status::ok) return result;
+
+    std::string value;
+    if (!skip_space(&q, end))
+      return q == end ? status::more : status::unsupported;
+    result = parse_pseudo_attribute(&q, end, "version", &value);
+    if (result != status::ok) return result;
+    if (value != "1.0") return status::unsupported;
+
+    const auto space = skip_space(&q, end);
+    if (q == end) return status::more;
+    if (space && *q == 'e') {
+      result = parse_pseudo_attribute(&q, end, "encoding", &value);
+      if (result != status::ok) return result;
+      string::ascii_tolower(&value);
+      if (value != "utf-8") return status::unsupported;
+      skip_space(&q, end);
+    }
+
+    result = skip_literal(&q, end, "?>");
+    if (result != status::ok) return result;
+
+    *p = q;
+    return status::ok;
+  }
+
+  // Parses `name`, an equals sign and a quoted value, as found in the XML
+  // declaration.  The value cannot contain references.
+  static status parse_pseudo_attribute(const char** p, const char* end,
+                                       const char* name, std::string* value) {
+    auto result = skip_literal(p, end, name);
+    if (result != status::ok) return result;
+    skip_space(p, end);
+    result = skip_literal(p, end, "=");
+    if (result != status::ok) return result;
+    skip_space(p, end);
+    if (*p == end) return status::more;
+
+    const auto quote = **p;
+    if (quote != '"' && quote != '\'') return status::unsupported;
+    const auto begin = *p + 1;
+    const auto close = static_cast<const char*>(
+        std::memchr(begin, quote, end - begin));
+    if (!close) return status::more;
+
+    value->assign(begin, close);
+    *p = close + 1;
+    return status::ok;
+  }
+
+  static status skip_literal(const char** p, const char* end,
+                             const char* literal) {
+    for (; *literal; ++literal, ++*p) {
+      if (*p == end) return status::more;
+      if (**p != *literal) return status::unsupported;
+    }
+    return status::ok;
+  }
+
+  // Skips white space outside the document element, where nothing else but
+  // markup may appear.
+  static status skip_prolog(const char** p, const char* end) {
+    skip_space(p, end);
+    if (*p != end && **p != '<') return status::unsupported;
+    return status::ok;
+  }
+
+  void emit(const char* text, size_t len) {
+    if (len) text_(user_data_, text, static_cast<int>(len));
+  }
+
+  void* const user_data_;
+  const start_handler start_;
+  const end_handler end_;
+  const text_handler text_;
+  const char separator_;
+
+  bool failed_ = false;
+  bool root_ended_ = false;
+
+  // True once anything has been parsed.
+  bool started_ = false;
+
+  // Input that has not been parsed yet.
+  std::string buffer_;
+
+  std::vector<element> elements_;
+  std::vector<std::string> namespaces_;
+
+  // The start tags of the open elements, back to back.
+  std::string tags_;
+
+  // The reported names of the open elements, NUL terminated.
+  std::string names_;
+
+  // The attributes of the current start tag.
+  std::vector<attribute> attributes_;
+  std::string values_;
+  std::vector<const char*> atts_;
+
+  std::string scratch_;
+};
+
+}  // namespace xml
@@ -0,0 +1,92 @@
+// Compares the throughput of xml::fast_parser with Expat on a large page of
+// styled lines and tables, fed in parts as they arrive from the network.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <expat.h>
+
+#include "util/bench.h"
+#include "util/xml.h"
+
+namespace {
+
+std::string make_page(size_t size) {
+  std::string result =
+      "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+      "<ttyml xmlns=\"https://ttyml.org/2018/05/26\">\n"
+      "<table>\n";
+
+  for (size_t i = 0; result.size() < size; ++i) {
+    if (i % 4 == 0) {
+      result += "<line>Line " + std::to_string(i) +
+                " has <style fg=\"red\" bold=\"1\">styled</style> text, "
+                "&amp; an entity, and some more words to make it long "
+                "enough.</line>\n";
+    } else {
+      result += "<row><cell>" + std::to_string(i) +
+                "</cell><cell>Name &#x2014; description</cell><cell>"
+                "r\xc3\xa6kke</cell></row>\n";
+    }
+  }
+
+  return result + "</table>\n</ttyml>\n";
+}
+
+struct counts {
+  size_t elements = 0;
+  size_t bytes = 0;
+};
+
+void on_start(void* user_data, const char*, const char**) {
+  ++static_cast<counts*>(user_data)->elements;
+}
+
+void on_end(void*, const char*) {}
+
+void on_text(void* user_data, const char*, int len) {
+  static_cast<counts*>(user_data)->bytes += len;
+}
+
+}  // namespace
+
+int main() {
+  static const size_t kChunkSize = 16384;
+
+  const auto page = make_page(4 << 20);
+
+  const auto expat = bench::run(
+      "expat",
+      [&] {
+        counts c;
+        const auto parser = XML_ParserCreateNS("utf-8", '|');
+        XML_SetUserData(parser, &c);
+        XML_SetElementHandler(parser, on_start, on_end);
+        XML_SetCharacterDataHandler(parser, on_text);
+        for (size_t i = 0; i < page.size(); i += kChunkSize) {
+          const auto size = std::min(kChunkSize, page.size() - i);
+          XML_Parse(parser, page.data() + i, size, i + size == page.size());
+        }
+        XML_ParserFree(parser);
+        bench::do_not_optimize(c);
+      },
+      page.size(), 1.0);
+  std::printf("%-32s %12.1f MB/s\n", "", 1e3 / expat.ns_per_op);
+
+  const auto fast = bench::run(
+      "fast_parser",
+      [&] {
+        counts c;
+        xml::fast_parser parser{&c, on_start, on_end, on_text, '|'};
+        for (size_t i = 0; i < page.size(); i += kChunkSize) {
+          const auto size = std::min(kChunkSize, page.size() - i);
+          if (!parser.parse(page.data() + i, size, i + size == page.size()))
+            std::abort();
+        }
+        bench::do_not_optimize(c);
+      },
+      page.size(), 1.0);
+  std::printf("%-32s %12.1f MB/s\n", "", 1e3 / fast.ns_per_op);
+}
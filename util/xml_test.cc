@@ -0,0 +1,245 @@
+#include "util/xml.h"
+
+#include <memory>
+#include <random>
+
+#include <expat.h>
+
+#include "util/string.h"
+
+#include "third_party/gtest/include/gtest/gtest.h"
+
+namespace {
+
+struct parse_result {
+  bool ok = true;
+
+  // True if the fast parser handled the whole document.
+  bool fast = true;
+
+  // Tags and text, with adjacent text merged, since the parsers split text
+  // differently.
+  std::vector<std::string> events;
+};
+
+void on_start(void* user_data, const char* name, const char** atts) {
+  auto& events = static_cast<parse_result*>(user_data)->events;
+  std::string event = string::cat("<", name);
+  for (size_t i = 0; atts[i]; i += 2)
+    event += string::cat(" ", atts[i], "='", atts[i + 1], "'");
+  events.emplace_back(event + ">");
+}
+
+void on_end(void* user_data, const char* name) {
+  static_cast<parse_result*>(user_data)->events.emplace_back(
+      string::cat("</", name, ">"));
+}
+
+void on_text(void* user_data, const char* text, int len) {
+  auto& events = static_cast<parse_result*>(user_data)->events;
+  if (events.empty() || events.back()[0] == '<') events.emplace_back();
+  events.back().append(text, len);
+}
+
+using expat_parser =
+    std::unique_ptr<XML_ParserStruct, decltype(&XML_ParserFree)>;
+
+expat_parser make_expat(parse_result* result) {
+  expat_parser parser{XML_ParserCreateNS("utf-8", '|'), XML_ParserFree};
+  XML_SetUserData(parser.get(), result);
+  return parser;
+}
+
+void set_handlers(XML_Parser parser) {
+  XML_SetElementHandler(parser, on_start, on_end);
+  XML_SetCharacterDataHandler(parser, on_text);
+}
+
+parse_result parse_with_expat(const std::string& document) {
+  parse_result result;
+  result.fast = false;
+  const auto parser = make_expat(&result);
+  set_handlers(parser.get());
+  result.ok = XML_STATUS_OK == XML_Parse(parser.get(), document.data(),
+                                         document.size(), 1);
+  return result;
+}
+
+// Parses `document` in parts of `chunk_size` bytes with the fast parser,
+// handing over to Expat the way ttyml::Context does if it gives up.
+parse_result parse_fast(const std::string& document, size_t chunk_size) {
+  parse_result result;
+  xml::fast_parser fast{&result, on_start, on_end, on_text, '|'};
+  expat_parser expat{nullptr, XML_ParserFree};
+
+  for (size_t i = 0; i <= document.size() && result.ok; i += chunk_size) {
+    const auto data = document.data() + i;
+    const auto size = std::min(chunk_size, document.size() - i);
+    const auto final = (i + chunk_size >= document.size());
+
+    if (!expat && fast.parse(data, size, final)) continue;
+
+    if (!expat) {
+      result.fast = false;
+      expat = make_expat(&result);
+      const auto prefix = fast.prefix();
+      const auto& rest = fast.rest();
+      result.ok =
+          XML_STATUS_OK ==
+              XML_Parse(expat.get(), prefix.data(), prefix.size(), 0) &&
+          (set_handlers(expat.get()),
+           XML_STATUS_OK ==
+               XML_Parse(expat.get(), rest.data(), rest.size(), final));
+    } else {
+      result.ok = XML_STATUS_OK == XML_Parse(expat.get(), data, size, final);
+    }
+
+    if (final) break;
+  }
+
+  return result;
+}
+
+// Checks that the fast parser agrees with Expat on `document`, whichever way
+// it is split, and returns whether it handled the document by itself.
+bool check(const std::string& document) {
+  const auto expected = parse_with_expat(document);
+
+  auto fast = true;
+  for (const size_t chunk_size : {size_t{1}, size_t{2}, size_t{3}, size_t{7},
+                                  size_t{64}, document.size() + 1}) {
+    const auto result = parse_fast(document, chunk_size);
+    EXPECT_EQ(expected.ok, result.ok) << document << "\nchunk size "
+                                      << chunk_size;
+    if (expected.ok && result.ok) {
+      EXPECT_EQ(expected.events, result.events) << document << "\nchunk size "
+                                                << chunk_size;
+    }
+    fast = fast && result.fast;
+  }
+
+  return fast;
+}
+
+const char kPage[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+    "<ttyml xmlns=\"https://ttyml.org/2018/05/26\">\r\n"
+    "  <line>Hello, <style fg='red' bold=\"1\">w&#246;rld</style> &amp; "
+    "&lt;friends&gt;&#x1F600;</line>\n"
+    "  <table><row><cell>\xc3\xa6\xc3\xb8\xc3\xa5</cell><cell>]]</cell>"
+    "</row></table>\r"
+    "  <form action=\"/next?a=1&amp;b=2\" method=\"post\">\n"
+    "    <var name=\"state\" value=\"a&#10;b\tc\r\nd\"/>\n"
+    "    <prompt name=\"q\" type=\"text\" >Name: </prompt>\n"
+    "  </form>\n"
+    "</ttyml>\n";
+
+TEST(XmlTest, Page) {
+  EXPECT_TRUE(check(kPage));
+
+  const std::string page{kPage};
+  EXPECT_TRUE(check(page.substr(page.find('\n') + 1)));
+}
+
+TEST(XmlTest, Declaration) {
+  EXPECT_TRUE(check("<?xml version='1.0'?><a/>"));
+  EXPECT_TRUE(check("<?xml version = \"1.0\"  encoding='UTF-8' ?>\n<a/>"));
+
+  // Other declarations are left to Expat.
+  EXPECT_FALSE(check("<?xml version='1.1'?><a/>"));
+  EXPECT_FALSE(check("<?xml version='1.0' encoding='us-ascii'?><a/>"));
+  EXPECT_FALSE(check("<?xml version='1.0' standalone='yes'?><a/>"));
+  EXPECT_FALSE(check("<?xml-stylesheet href='a.css'?><a/>"));
+}
+
+TEST(XmlTest, Namespaces) {
+  EXPECT_TRUE(check("<a xmlns='urn:x'><b/><c xmlns='urn:y' d='e'><f/></c>"
+                    "<g xmlns=''><h/></g><i/></a>"));
+  EXPECT_TRUE(check("<a><b xmlns='urn:x'/><c/></a>"));
+
+  // Prefixes are left to Expat.
+  EXPECT_FALSE(check("<a xmlns:p='urn:x'><p:b p:c='d'/></a>"));
+  EXPECT_FALSE(check("<a><b xml:lang='en'/></a>"));
+}
+
+TEST(XmlTest, Fallback) {
+  EXPECT_FALSE(check("<a>x<!-- comment -->y</a>"));
+  EXPECT_FALSE(check("<a>x<![CDATA[<y>]]>z</a>"));
+  EXPECT_FALSE(check("<a>x<?pi data?>y</a>"));
+  EXPECT_FALSE(check("<!DOCTYPE a>\n<a>x</a>"));
+  EXPECT_FALSE(check("<a>x</a>\n<!-- trailing -->\n"));
+  EXPECT_FALSE(check("<a><\xc3\xa6/>\xc3\xa6</a>"));
+  EXPECT_FALSE(check("\xef\xbb\xbf<a>x</a>"));
+  EXPECT_FALSE(check("<a b='&#65;&#x42;&quot;&apos;'>&#0000065;</a>"
+                     "<!---->"));
+}
+
+TEST(XmlTest, Errors) {
+  for (const auto& document : {
+           "",
+           "<a>",
+           "<a></b>",
+           "<a>x</a><b/>",
+           "<a>x</a>y",
+           "x<a/>",
+           "<a>]]></a>",
+           "<a>&unknown;</a>",
+           "<a>&#0;</a>",
+           "<a>&#xD800;</a>",
+           "<a>&#x110000;</a>",
+           "<a>&#xFFFE;</a>",
+           "<a>&#X41;</a>",
+           "<a>&#;</a>",
+           "<a>&amp</a>",
+           "<a b='<'/>",
+           "<a b='&'/>",
+           "<a b=c/>",
+           "<a b='c'd='e'/>",
+           "<a b='c' b='d'/>",
+           "<a xmlns='urn:x' xmlns='urn:x'/>",
+           "<a xmlns='http://www.w3.org/XML/1998/namespace'/>",
+           "<a>\x01</a>",
+           "<a>\xc0\x80</a>",
+           "<a>\xed\xa0\x80</a>",
+           "<a>\xef\xbf\xbe</a>",
+           "<a>\xf4\x90\x80\x80</a>",
+           "<a>\xe6\x97</a>",
+           "<a>\x80</a>",
+           "<a/ >",
+           "< a/>",
+           "<1/>",
+           "<?xml version='1.0'?>",
+           " <?xml version='1.0'?><a/>",
+           "<?xml version='1.0'?><?xml version='1.0'?><a/>",
+           "<?xml version='1.0'encoding='utf-8'?><a/>",
+           "<?xml encoding='utf-8'?><a/>",
+           "<?xml version='1.0' encoding='utf-8'><a/>",
+       }) {
+    check(document);
+  }
+}
+
+// Compares the parsers on random documents built from the pieces of valid
+// and invalid markup above.
+TEST(XmlTest, Random) {
+  static const char* const pieces[] = {
+      "<a>", "</a>", "<b x='1'>", "</b>", "<c/>", "<d xmlns='urn:d'>", "</d>",
+      "text", " ", "\n", "\r\n", "\r", "\t", "&amp;", "&#x263A;", "&lt",
+      "\xc3\xa6", "\xe2\x98\xba", "\xf0\x9f\x98\x80", "\xc3", "]]>", "]",
+      "<!--c-->", "<![CDATA[x]]>", "<e y=\"&quot;\r\n\" z='\t'/>", "<",
+      "&", "'", "\"", ">", "<p:f xmlns:p='urn:p'/>", "\x01"};
+
+  std::mt19937 rng{1234};
+  std::uniform_int_distribution<size_t> pick{
+      0, sizeof(pieces) / sizeof(pieces[0]) - 1};
+  std::uniform_int_distribution<int> length{0, 12};
+
+  for (int i = 0; i < 2000; ++i) {
+    std::string document = "<r>";
+    for (int n = length(rng); n > 0; --n) document += pieces[pick(rng)];
+    document += "</r>";
+    check(document);
+  }
+}
+
+}  // namespace
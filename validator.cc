@@ -0,0 +1,174 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "validator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "util/curl.h"
+#include "util/string.h"
+#include "util/url.h"
+
+namespace ttyml {
+
+namespace {
+
+// The most of a rejection message kept.
+const size_t kMaxMessage = 1024;
+
+// How long a check may take before the answer is accepted unchecked.
+const long kTimeoutSeconds = 10;
+
+void check_multi(CURLMcode ret, const char* function) {
+  if (ret != CURLM_OK)
+    throw std::runtime_error{
+        string::cat(function, " failed: ", curl_multi_strerror(ret))};
+}
+
+}  // namespace
+
+struct Validator::Check {
+  size_t index_ = 0;
+
+  std::unique_ptr<CURL, decltype(&curl_easy_cleanup)> curl_{
+      curl_easy_init(), curl_easy_cleanup};
+
+  std::string url_;
+
+  // The start of the response body.
+  std::string body_;
+};
+
+Validator::Validator(CURLSH* share, std::string ca_file)
+    : share_{share},
+      ca_file_{std::move(ca_file)},
+      multi_{curl_multi_init(), curl_multi_cleanup} {
+  if (!multi_) throw std::runtime_error{"curl_multi_init failed"};
+}
+
+Validator::~Validator() {
+  for (const auto& check : checks_)
+    curl_multi_remove_handle(multi_.get(), check->curl_.get());
+}
+
+void Validator::check(size_t index, const std::string& url,
+                      const std::string& name, const std::string& value) {
+  const auto earlier =
+      std::find_if(checks_.begin(), checks_.end(),
+                   [index](const std::unique_ptr<Check>& check) {
+                     return check->index_ == index;
+                   });
+  if (earlier != checks_.end()) {
+    check_multi(curl_multi_remove_handle(multi_.get(), (*earlier)->curl_.get()),
+                "curl_multi_remove_handle");
+    checks_.erase(earlier);
+  }
+
+  auto check = std::make_unique<Check>();
+  check->index_ = index;
+  if (!check->curl_) throw std::runtime_error{"curl_easy_init() failed"};
+
+  std::string query;
+  url::append_key_value(&query, "name", name);
+  url::append_key_value(&query, "value", value);
+
+  check->url_ = url.substr(0, url.find('#'));
+  check->url_.push_back(
+      (check->url_.find('?') == std::string::npos) ? '?' : '&');
+  check->url_.append(query);
+
+  const auto curl = check->curl_.get();
+  curl::set_session_options(curl, share_, ca_file_, PACKAGE_STRING);
+  curl::setopt(curl, CURLOPT_URL, check->url_.c_str());
+  curl::setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl::setopt(curl, CURLOPT_MAXREDIRS, 10L);
+  curl::setopt(curl, CURLOPT_TIMEOUT, kTimeoutSeconds);
+  curl::setopt(curl, CURLOPT_WRITEDATA, &check->body_);
+  curl::setopt(curl, CURLOPT_WRITEFUNCTION,
+               +[](const char* ptr, size_t size, size_t nmemb,
+                   void* void_body) -> size_t {
+                 const auto body = static_cast<std::string*>(void_body);
+                 const auto len = size * nmemb;
+                 if (body->size() < kMaxMessage)
+                   body->append(ptr, (len < kMaxMessage - body->size())
+                                         ? len
+                                         : kMaxMessage - body->size());
+                 return nmemb;
+               });
+  curl::setopt(curl, CURLOPT_PRIVATE, check.get());
+
+  check_multi(curl_multi_add_handle(multi_.get(), curl),
+              "curl_multi_add_handle");
+  checks_.emplace_back(std::move(check));
+}
+
+std::vector<Validator::Result> Validator::poll() {
+  if (checks_.empty()) return {};
+
+  int running;
+  check_multi(curl_multi_perform(multi_.get(), &running),
+              "curl_multi_perform");
+
+  return take_results();
+}
+
+std::vector<Validator::Result> Validator::wait() {
+  std::vector<Result> results;
+
+  while (!checks_.empty()) {
+    for (auto& result : poll()) results.emplace_back(std::move(result));
+
+    if (!checks_.empty())
+      check_multi(curl_multi_poll(multi_.get(), nullptr, 0, 1000, nullptr),
+                  "curl_multi_poll");
+  }
+
+  return results;
+}
+
+std::vector<Validator::Result> Validator::take_results() {
+  std::vector<Result> results;
+
+  int queued;
+  while (const auto message = curl_multi_info_read(multi_.get(), &queued)) {
+    if (message->msg != CURLMSG_DONE) continue;
+
+    const auto curl = message->easy_handle;
+    const auto transfer_result = message->data.result;
+
+    Check* check;
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, &check);
+
+    results.emplace_back();
+    auto& result = results.back();
+    result.index_ = check->index_;
+
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+
+    if (transfer_result != CURLE_OK) {
+      result.message_ = string::cat("could not check answer: ",
+                                    curl_easy_strerror(transfer_result));
+    } else if (status >= 400 && status < 500) {
+      result.valid_ = false;
+      result.message_ = std::move(check->body_);
+      string::strip(&result.message_);
+    } else if (status < 200 || status >= 300) {
+      result.message_ = string::cat(
+          "could not check answer: server responded with status ", status);
+    }
+
+    check_multi(curl_multi_remove_handle(multi_.get(), curl),
+                "curl_multi_remove_handle");
+    checks_.erase(std::find_if(checks_.begin(), checks_.end(),
+                               [check](const std::unique_ptr<Check>& c) {
+                                 return c.get() == check;
+                               }));
+  }
+
+  return results;
+}
+
+}  // namespace ttyml
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <curl/curl.h>
+
+namespace ttyml {
+
+// Checks answers to prompts with the server in the background, so that the
+// user can go on to the next prompt while an answer is being checked.
+//
+// An answer is checked by a GET request to the prompt's validate-url, with
+// the prompt's name and the answer added to the query string as `name` and
+// `value`.  A 2xx response accepts the answer, and a 4xx response rejects
+// it, with the response body as the reason.  Answers that cannot be checked
+// are accepted, since the server sees them again when the form is submitted.
+class Validator {
+ public:
+  struct Result {
+    // The prompt the answer was given for, as passed to `check`.
+    size_t index_ = 0;
+
+    // False if the server rejected the answer.
+    bool valid_ = true;
+
+    // Why the server rejected the answer, if it said, or why the answer could
+    // not be checked.
+    std::string message_;
+  };
+
+  // Transfers share DNS cache, TLS sessions and connections through `share`
+  // if set.  If `ca_file` is not empty, server certificates are verified
+  // against it instead of the default certificate authorities.
+  Validator(CURLSH* share, std::string ca_file);
+  ~Validator();
+
+  Validator(const Validator&) = delete;
+  Validator& operator=(const Validator&) = delete;
+
+  // Starts checking `value` as the answer to prompt `index`, named `name`,
+  // with the endpoint at `url`.  Any check of an earlier answer to the same
+  // prompt is abandoned.
+  void check(size_t index, const std::string& url, const std::string& name,
+             const std::string& value);
+
+  // Returns true if any checks have not completed.
+  bool pending() const { return !checks_.empty(); }
+
+  // Makes progress on the checks without blocking, and returns those that
+  // have completed.
+  std::vector<Result> poll();
+
+  // Waits for every check to complete, and returns their results.
+  std::vector<Result> wait();
+
+ private:
+  struct Check;
+
+  std::vector<Result> take_results();
+
+  CURLSH* const share_;
+  const std::string ca_file_;
+
+  std::unique_ptr<CURLM, decltype(&curl_multi_cleanup)> multi_;
+
+  std::vector<std::unique_ptr<Check>> checks_;
+};
+
+}  // namespace ttyml
@@ -0,0 +1,185 @@
+#include "validator.h"
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "third_party/gtest/include/gtest/gtest.h"
+
+namespace {
+
+// Answers HTTP requests on the loopback interface, one at a time, with the
+// status and body returned by a handler given the request target.
+class Server {
+ public:
+  using Handler = std::function<std::pair<int, std::string>(std::string)>;
+
+  explicit Server(Handler handler) : handler_{std::move(handler)} {
+    fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    EXPECT_NE(-1, fd_);
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    EXPECT_EQ(0, bind(fd_, reinterpret_cast<const sockaddr*>(&address),
+                      sizeof(address)));
+    EXPECT_EQ(0, listen(fd_, 16));
+
+    socklen_t length = sizeof(address);
+    getsockname(fd_, reinterpret_cast<sockaddr*>(&address), &length);
+    url_ = "http://127.0.0.1:" + std::to_string(ntohs(address.sin_port)) +
+           "/check";
+
+    thread_ = std::thread{[this] { serve(); }};
+  }
+
+  ~Server() {
+    shutdown(fd_, SHUT_RDWR);
+    thread_.join();
+    close(fd_);
+  }
+
+  const std::string& url() const { return url_; }
+
+  // Returns the targets of the requests received so far, in sorted order.
+  std::vector<std::string> targets() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto result = targets_;
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+ private:
+  void serve() {
+    for (;;) {
+      const auto fd = accept4(fd_, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd == -1) return;
+
+      std::string request;
+      char buffer[4096];
+      while (request.find("\r\n\r\n") == std::string::npos) {
+        const auto ret = read(fd, buffer, sizeof(buffer));
+        if (ret <= 0) break;
+        request.append(buffer, ret);
+      }
+
+      const auto start = request.find(' ') + 1;
+      const auto target =
+          request.substr(start, request.find(' ', start) - start);
+      {
+        std::lock_guard<std::mutex> lock{mutex_};
+        targets_.emplace_back(target);
+      }
+
+      const auto response = handler_(target);
+      const auto text = "HTTP/1.1 " + std::to_string(response.first) +
+                        " Status\r\nContent-Length: " +
+                        std::to_string(response.second.size()) +
+                        "\r\nConnection: close\r\n\r\n" + response.second;
+      EXPECT_EQ(static_cast<ssize_t>(text.size()),
+                write(fd, text.data(), text.size()));
+      close(fd);
+    }
+  }
+
+  const Handler handler_;
+  int fd_;
+  std::string url_;
+  std::thread thread_;
+
+  std::mutex mutex_;
+  std::vector<std::string> targets_;
+};
+
+// Accepts answers containing "ok", and rejects others.
+std::pair<int, std::string> accept_ok(const std::string& target) {
+  if (target.find("value=ok") != std::string::npos) return {200, ""};
+  return {422, "  Must be ok.\n"};
+}
+
+TEST(ValidatorTest, Results) {
+  Server server{accept_ok};
+  ttyml::Validator validator{nullptr, ""};
+
+  validator.check(0, server.url(), "first", "ok");
+  validator.check(1, server.url(), "second", "not ok");
+  EXPECT_TRUE(validator.pending());
+
+  auto results = validator.wait();
+  EXPECT_FALSE(validator.pending());
+  ASSERT_EQ(2U, results.size());
+  std::sort(results.begin(), results.end(),
+            [](const ttyml::Validator::Result& lhs,
+               const ttyml::Validator::Result& rhs) {
+              return lhs.index_ < rhs.index_;
+            });
+
+  EXPECT_TRUE(results[0].valid_);
+  EXPECT_EQ("", results[0].message_);
+
+  EXPECT_FALSE(results[1].valid_);
+  EXPECT_EQ("Must be ok.", results[1].message_);
+
+  const auto targets = server.targets();
+  ASSERT_EQ(2U, targets.size());
+  EXPECT_EQ("/check?name=first&value=ok", targets[0]);
+  EXPECT_EQ("/check?name=second&value=not%20ok", targets[1]);
+}
+
+TEST(ValidatorTest, QueryString) {
+  Server server{accept_ok};
+  ttyml::Validator validator{nullptr, ""};
+
+  validator.check(0, server.url() + "?form=1#fragment", "name", "ok");
+  validator.wait();
+
+  const auto targets = server.targets();
+  ASSERT_EQ(1U, targets.size());
+  EXPECT_EQ("/check?form=1&name=name&value=ok", targets[0]);
+}
+
+TEST(ValidatorTest, LaterAnswerReplacesEarlier) {
+  Server server{accept_ok};
+  ttyml::Validator validator{nullptr, ""};
+
+  validator.check(0, server.url(), "name", "bad");
+  validator.check(0, server.url(), "name", "ok");
+
+  const auto results = validator.wait();
+  ASSERT_EQ(1U, results.size());
+  EXPECT_TRUE(results[0].valid_);
+}
+
+TEST(ValidatorTest, UncheckedAnswersAreAccepted) {
+  Server server{[](const std::string&) {
+    return std::make_pair(500, std::string{"Internal error"});
+  }};
+  ttyml::Validator validator{nullptr, ""};
+
+  validator.check(0, server.url(), "name", "value");
+
+  auto results = validator.wait();
+  ASSERT_EQ(1U, results.size());
+  EXPECT_TRUE(results[0].valid_);
+  EXPECT_EQ("could not check answer: server responded with status 500",
+            results[0].message_);
+
+  // Nothing listens on port 1.
+  validator.check(0, "http://127.0.0.1:1/check", "name", "value");
+
+  results = validator.wait();
+  ASSERT_EQ(1U, results.size());
+  EXPECT_TRUE(results[0].valid_);
+  EXPECT_EQ(0U, results[0].message_.find("could not check answer: "));
+}
+
+}  // namespace